@@ -1,9 +1,14 @@
 #include <fstream>
 #include <iostream>
 #include <mutex>
+#include <random>
+#include <algorithm>
+#include <chrono>
 #include "gtest/gtest.h"
 #include "global.h"
 #include "parfis.h"
+#include "random.h"
+#include "simd.h"
 #include "define.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -105,7 +110,7 @@ TEST(api, createCells) {
     parfis::api::loadSimData(id);
     parfis::api::runCommandChain(id, "create");
     ASSERT_EQ(139200, parfis::api::getSimData(id)->cellVec.size());
-    ASSERT_EQ(160000, parfis::api::getSimData(id)->cellIdVec.size());
+    ASSERT_EQ(400, parfis::api::getSimData(id)->cellIndex.columnVec.size());
     // No particle creation is performed because of missins createStates command
     ASSERT_EQ(0, parfis::api::getSimData(id)->stateVec.size());
     parfis::api::deleteParfis(id);
@@ -129,7 +134,7 @@ TEST(api, userDefinedCfgString) {
     parfis::api::loadSimData(id);
     parfis::api::runCommandChain(id, "create");
     ASSERT_EQ(139200, parfis::api::getSimData(id)->cellVec.size());
-    ASSERT_EQ(160000, parfis::api::getSimData(id)->cellIdVec.size());
+    ASSERT_EQ(400, parfis::api::getSimData(id)->cellIndex.columnVec.size());
     ASSERT_EQ(0, parfis::api::getSimData(id)->stateVec.size());
     uint64_t ptr1 = reinterpret_cast<uint64_t>(&parfis::api::getSimData(id)->cellVec[0]);
     uint64_t ptr2 = reinterpret_cast<uint64_t>(&parfis::api::getSimData(id)->cellVec[1]);
@@ -138,6 +143,170 @@ TEST(api, userDefinedCfgString) {
     parfis::api::deleteParfis(id);
 }
 
+/**
+ * @brief Check the cell index, every cell is found from its position and positions 
+ * without cells give Const::noCellId
+ */
+TEST(api, cellIndex) {
+    uint32_t id = parfis::api::newParfis();
+    parfis::api::setConfig(id, "commandChain.create = [createCells]");
+    parfis::api::loadCfgData(id);
+    parfis::api::loadSimData(id);
+    parfis::api::runCommandChain(id, "create");
+    const parfis::SimData* pSimData = parfis::api::getSimData(id);
+    const parfis::Vec3D<int>& cellCount = parfis::api::getCfgData(id)->cellCount;
+    const parfis::CellIndex& cellIndex = pSimData->cellIndex;
+    for (size_t i = 0; i < pSimData->cellVec.size(); i++)
+        ASSERT_EQ(i, cellIndex.cellId(pSimData->cellVec[i].pos));
+    size_t cellCnt = 0;
+    parfis::Vec3D<parfis::cellPos_t> pos;
+    for (pos.x = 0; pos.x < cellCount.x; pos.x++)
+        for (pos.y = 0; pos.y < cellCount.y; pos.y++)
+            for (pos.z = 0; pos.z < cellCount.z; pos.z++)
+                cellCnt += cellIndex.cellId(pos) != parfis::Const::noCellId;
+    ASSERT_EQ(pSimData->cellVec.size(), cellCnt);
+    // Cells must have consecutive ids in a column
+    std::vector<parfis::Cell> cellVec = {{{0, 0, 0}}, {{0, 1, 0}}, {{0, 0, 1}}};
+    parfis::CellIndex tmpIndex;
+    ASSERT_EQ(1, tmpIndex.build(cellVec, {1, 2, 2}));
+    cellVec = {{{0, 0, 0}}, {{0, 0, 1}}, {{0, 1, 1}}};
+    ASSERT_EQ(0, tmpIndex.build(cellVec, {1, 2, 2}));
+    ASSERT_EQ(parfis::Const::noCellId, tmpIndex.cellId({0, 1, 0}));
+    ASSERT_EQ(2, tmpIndex.cellId({0, 1, 1}));
+    parfis::api::deleteParfis(id);
+}
+
+/**
+ * @brief Check cells created with several threads, cells are the same as with one 
+ * thread, and a cell is in group A only if the cell and all its neighbours are full
+ */
+TEST(api, createCellsThreads) {
+    uint32_t id[2];
+    int threadsVec[2] = {1, 4};
+    for (int i = 0; i < 2; i++) {
+        id[i] = parfis::api::newParfis();
+        parfis::api::setConfig(id[i], "commandChain.create = [createCells]");
+        parfis::api::setConfig(id[i], "system.geometrySize = [0.0313, 0.0313, 0.02]");
+        parfis::api::setConfig(id[i], 
+            ("system.threads = " + std::to_string(threadsVec[i])).c_str());
+        parfis::api::loadCfgData(id[i]);
+        parfis::api::loadSimData(id[i]);
+        parfis::api::runCommandChain(id[i], "create");
+    }
+    const parfis::SimData* pSimData = parfis::api::getSimData(id[0]);
+    const parfis::SimData* pSimDataB = parfis::api::getSimData(id[1]);
+    ASSERT_EQ(pSimData->cellVec.size(), pSimDataB->cellVec.size());
+    for (size_t i = 0; i < pSimData->cellVec.size(); i++) {
+        ASSERT_EQ(pSimData->cellVec[i].pos, pSimDataB->cellVec[i].pos);
+        ASSERT_EQ(pSimData->nodeFlagVec[i], pSimDataB->nodeFlagVec[i]);
+    }
+    ASSERT_EQ(pSimData->cellIdAVec, pSimDataB->cellIdAVec);
+    ASSERT_EQ(pSimData->cellIdBVec, pSimDataB->cellIdBVec);
+    ASSERT_EQ(pSimData->cellVec.size(), 
+        pSimData->cellIdAVec.size() + pSimData->cellIdBVec.size());
+    ASSERT_TRUE(std::is_sorted(pSimData->cellIdBVec.begin(), pSimData->cellIdBVec.end()));
+    for (parfis::cellId_t cellId = 0; cellId < pSimData->cellVec.size(); cellId++) {
+        bool full = pSimData->nodeFlagVec[cellId] == 0b11111111;
+        for (int i = -1; i < 2 && full; i++)
+            for (int j = -1; j < 2 && full; j++)
+                for (int k = -1; k < 2 && full; k++) {
+                    parfis::Vec3D<parfis::cellPos_t> pos = pSimData->cellVec[cellId].pos;
+                    pos = {parfis::cellPos_t(pos.x + i), parfis::cellPos_t(pos.y + j), 
+                        parfis::cellPos_t(pos.z + k)};
+                    parfis::cellId_t nId = pSimData->cellIndex.cellId(pos);
+                    if (nId != parfis::Const::noCellId)
+                        full = pSimData->nodeFlagVec[nId] == 0b11111111;
+                }
+        ASSERT_EQ(full, std::binary_search(pSimData->cellIdAVec.begin(), 
+            pSimData->cellIdAVec.end(), cellId));
+    }
+    for (int i = 0; i < 2; i++)
+        parfis::api::deleteParfis(id[i]);
+}
+
+/**
+ * @brief Check keys of the space-filling curves, consecutive points on the Hilbert 
+ * curve are neighbours
+ */
+TEST(api, curveKeys) {
+    ASSERT_EQ(1, parfis::Global::mortonKey(0, 0, 1));
+    ASSERT_EQ(2, parfis::Global::mortonKey(0, 1, 0));
+    ASSERT_EQ(4, parfis::Global::mortonKey(1, 0, 0));
+    ASSERT_EQ(63, parfis::Global::mortonKey(3, 3, 3));
+    ASSERT_EQ(511, parfis::Global::mortonKey(7, 7, 7));
+    std::vector<std::pair<uint64_t, parfis::Vec3D<int>>> pointVec;
+    for (int x = 0; x < 8; x++)
+        for (int y = 0; y < 8; y++)
+            for (int z = 0; z < 8; z++)
+                pointVec.push_back({parfis::Global::hilbertKey(x, y, z, 3), {x, y, z}});
+    std::sort(pointVec.begin(), pointVec.end(), 
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+    ASSERT_EQ(0, pointVec.front().first);
+    ASSERT_EQ(511, pointVec.back().first);
+    for (size_t i = 1; i < pointVec.size(); i++) {
+        const parfis::Vec3D<int>& a = pointVec[i - 1].second;
+        const parfis::Vec3D<int>& b = pointVec[i].second;
+        ASSERT_EQ(pointVec[i].first, pointVec[i - 1].first + 1);
+        ASSERT_EQ(1, abs(b.x - a.x) + abs(b.y - a.y) + abs(b.z - a.z));
+    }
+}
+
+/**
+ * @brief Check cells ordered along the Morton and Hilbert curves, the cells and the 
+ * groups of cells are the same as for the loop order, and neighbours in x are closer
+ */
+TEST(api, cellOrder) {
+    uint32_t id[3];
+    double meanDist[3];
+    for (int order = 0; order < 3; order++) {
+        id[order] = parfis::api::newParfis();
+        parfis::api::setConfig(id[order], 
+            ("system.cellOrder = " + std::to_string(order)).c_str());
+        parfis::api::loadCfgData(id[order]);
+        parfis::api::loadSimData(id[order]);
+        parfis::api::runCommandChain(id[order], "create");
+        const parfis::SimData* pSimData = parfis::api::getSimData(id[order]);
+        ASSERT_EQ(order, parfis::api::getCfgData(id[order])->cellOrder);
+        meanDist[order] = 0;
+        for (size_t i = 0; i < pSimData->cellVec.size(); i++) {
+            parfis::Vec3D<parfis::cellPos_t> pos = pSimData->cellVec[i].pos;
+            ASSERT_EQ(i, pSimData->cellIndex.cellId(pos));
+            // The index is defined only for positions inside of the grid
+            if (pos.x + 1 >= parfis::api::getCfgData(id[order])->cellCount.x)
+                continue;
+            pos.x++;
+            parfis::cellId_t nId = pSimData->cellIndex.cellId(pos);
+            if (nId != parfis::Const::noCellId)
+                meanDist[order] += abs(double(nId) - double(i));
+        }
+        meanDist[order] /= pSimData->cellVec.size();
+        std::cout << GTEST_BOX << "cell order " << order << 
+            ", mean id distance of x neighbours: " << meanDist[order] << std::endl;
+    }
+    const parfis::SimData* pSimDataLoop = parfis::api::getSimData(id[0]);
+    for (int order = 1; order < 3; order++) {
+        const parfis::SimData* pSimData = parfis::api::getSimData(id[order]);
+        ASSERT_EQ(pSimDataLoop->cellVec.size(), pSimData->cellVec.size());
+        // States in the cells at the wall are random, with streams keyed by the cell id
+        ASSERT_NEAR(double(pSimDataLoop->stateVec.size()), double(pSimData->stateVec.size()), 
+            1e-3*pSimDataLoop->stateVec.size());
+        ASSERT_LT(meanDist[order], meanDist[0]);
+        for (size_t i = 0; i < pSimData->cellVec.size(); i++)
+            ASSERT_EQ(pSimDataLoop->nodeFlagVec[i], pSimData->nodeFlagVec[
+                pSimData->cellIndex.cellId(pSimDataLoop->cellVec[i].pos)]);
+        ASSERT_EQ(pSimDataLoop->cellIdAVec.size(), pSimData->cellIdAVec.size());
+        ASSERT_TRUE(std::is_sorted(pSimData->cellIdAVec.begin(), pSimData->cellIdAVec.end()));
+        for (auto cellId : pSimDataLoop->cellIdAVec)
+            ASSERT_TRUE(std::binary_search(pSimData->cellIdAVec.begin(), 
+                pSimData->cellIdAVec.end(), 
+                pSimData->cellIndex.cellId(pSimDataLoop->cellVec[cellId].pos)));
+        for (int i = 0; i < 10; i++)
+            ASSERT_EQ(0, parfis::api::runCommandChain(id[order], "evolve"));
+    }
+    for (int order = 0; order < 3; order++)
+        parfis::api::deleteParfis(id[order]);
+}
+
 /**
  * @brief Config specie
  */
@@ -253,7 +422,8 @@ TEST(api, createCellsAndStates) {
         parfis::api::getCfgData(id)->geometrySize.y * parfis::api::getCfgData(id)->geometrySize.z;
 
     uint32_t numStatesCyl = parfis::api::getSimData(id)->stateVec.size();
-    uint32_t numCells = parfis::api::getSimData(id)->cellIdVec.size();
+    const parfis::Vec3D<int>& cellCount = parfis::api::getCfgData(id)->cellCount;
+    uint32_t numCells = cellCount.x*cellCount.y*cellCount.z;
     uint32_t numStatesCub = numCells*parfis::api::getSimData(id)->specieVec[0].statesPerCell;
     double volRatio = volCyl/volCub;
     double stateRatio = double(numStatesCyl)/double(numStatesCub);
@@ -307,8 +477,8 @@ TEST(api, pySimData) {
     ASSERT_EQ(0, parfis::api::getPySimData(id)->specieVec.ptr[0].velInitDist);
     ASSERT_EQ(parfis::api::getSimData(id)->stateVec.size(), 
         parfis::api::getPySimData(id)->stateVec.size);
-    ASSERT_EQ(parfis::api::getSimData(id)->cellIdVec.size(), 
-        parfis::api::getPySimData(id)->cellIdVec.size);
+    ASSERT_EQ(parfis::api::getSimData(id)->cellIndex.columnVec.size(), 
+        parfis::api::getPySimData(id)->cellColumnVec.size);
     ASSERT_EQ(parfis::api::getSimData(id)->specieVec[0].statesPerCell, 
         parfis::api::getPySimData(id)->specieVec.ptr[0].statesPerCell);
     parfis::api::deleteParfis(id);
@@ -370,20 +540,20 @@ TEST(api, gasCollisionDefinition) {
     ASSERT_EQ(std::string(pSimData->gasCollisionVec[id1].fileName), "./data/cross_sections/simple_i.csv");
     std::vector<double> ranges = {1, 10, 100, 1000, 10000, 342000};
     std::vector<int> nbins = {1000, 1000, 1000, 1000, 1000, 3000};
-    ASSERT_EQ(true, nbins == pSimData->gasCollisionVec[id0].xSecFtab.nbins);
-    ASSERT_EQ(true, ranges == pSimData->gasCollisionVec[id0].xSecFtab.ranges);
-    ASSERT_EQ(true, nbins == pSimData->gasCollisionVec[id1].xSecFtab.nbins);
-    ASSERT_EQ(true, ranges == pSimData->gasCollisionVec[id1].xSecFtab.ranges);
-    ASSERT_EQ(8000, pSimData->gasCollisionVec[id0].xSecFtab.xVec.size());
-    ASSERT_EQ(8000, pSimData->gasCollisionVec[id0].xSecFtab.yVec.size());
-    ASSERT_EQ(8000, pSimData->gasCollisionVec[id1].xSecFtab.xVec.size());
-    ASSERT_EQ(8000, pSimData->gasCollisionVec[id1].xSecFtab.yVec.size());
-    ASSERT_EQ(8000, pSimData->gasCollisionVec[id0].xSecFtab.colCnt);
-    ASSERT_EQ(8000, pSimData->gasCollisionVec[id1].xSecFtab.colCnt);
-    ASSERT_EQ(1, pSimData->gasCollisionVec[id0].xSecFtab.rowCnt);
-    ASSERT_EQ(1, pSimData->gasCollisionVec[id1].xSecFtab.rowCnt);
-    ASSERT_EQ(8000, pSimData->gasCollisionVec[id0].xSecFtab.colCnt);
-    ASSERT_EQ(8000, pSimData->gasCollisionVec[id1].xSecFtab.colCnt);
+    ASSERT_EQ(true, nbins == pSimData->gasCollisionVec[id0].xSecFtab->nbins);
+    ASSERT_EQ(true, ranges == pSimData->gasCollisionVec[id0].xSecFtab->ranges);
+    ASSERT_EQ(true, nbins == pSimData->gasCollisionVec[id1].xSecFtab->nbins);
+    ASSERT_EQ(true, ranges == pSimData->gasCollisionVec[id1].xSecFtab->ranges);
+    ASSERT_EQ(8000, pSimData->gasCollisionVec[id0].xSecFtab->xVec.size());
+    ASSERT_EQ(8000, pSimData->gasCollisionVec[id0].xSecFtab->yVec.size());
+    ASSERT_EQ(8000, pSimData->gasCollisionVec[id1].xSecFtab->xVec.size());
+    ASSERT_EQ(8000, pSimData->gasCollisionVec[id1].xSecFtab->yVec.size());
+    ASSERT_EQ(8000, pSimData->gasCollisionVec[id0].xSecFtab->colCnt);
+    ASSERT_EQ(8000, pSimData->gasCollisionVec[id1].xSecFtab->colCnt);
+    ASSERT_EQ(1, pSimData->gasCollisionVec[id0].xSecFtab->rowCnt);
+    ASSERT_EQ(1, pSimData->gasCollisionVec[id1].xSecFtab->rowCnt);
+    ASSERT_EQ(8000, pSimData->gasCollisionVec[id0].xSecFtab->colCnt);
+    ASSERT_EQ(8000, pSimData->gasCollisionVec[id1].xSecFtab->colCnt);
     ASSERT_EQ(2, pSimData->gasCollisionProbVec[id0].colCnt);
     ASSERT_EQ(8000, pSimData->gasCollisionProbVec[idp].rowCnt);    
     ASSERT_EQ(8000, pSimData->gasCollisionProbVec[idp].xVec.size());
@@ -391,6 +561,336 @@ TEST(api, gasCollisionDefinition) {
     parfis::api::deleteParfis(id);
 }
 
+/**
+ * @brief Check the binary cache of FuncTable::loadData, the cache is used only with 
+ * the same data file and a valid checksum
+ */
+TEST(api, funcTableCache) {
+    std::string fileName = "./test_funcTableCache.csv";
+    std::string cacheName = fileName + parfis::FuncTable::cacheExtension;
+    std::string content;
+    ASSERT_EQ(0, parfis::Global::readFile("./data/cross_sections/simple_e.csv", content));
+    std::ofstream(fileName, std::ios::binary) << content;
+    std::remove(cacheName.c_str());
+    parfis::FuncTable ftab;
+    ftab.type = 1;
+    ASSERT_EQ(0, ftab.loadData(fileName));
+    ASSERT_FALSE(parfis::Global::fileExists(cacheName));
+    ASSERT_EQ(0, ftab.loadData(fileName, true));
+    ASSERT_TRUE(parfis::Global::fileExists(cacheName));
+    uint64_t sourceHash = parfis::Global::hash(content.data(), content.size());
+    auto checkEqual = [&](const parfis::FuncTable& cached) {
+        ASSERT_EQ(ftab.colCnt, cached.colCnt);
+        ASSERT_EQ(ftab.ranges, cached.ranges);
+        ASSERT_EQ(ftab.nbins, cached.nbins);
+        ASSERT_EQ(ftab.xVec, cached.xVec);
+        ASSERT_EQ(ftab.yVec, cached.yVec);
+        ASSERT_EQ(ftab.idx, cached.idx);
+    };
+    parfis::FuncTable cached;
+    ASSERT_EQ(0, cached.readCache(cacheName, sourceHash));
+    ASSERT_EQ(1, cached.readCache(cacheName, sourceHash + 1));
+    cached = parfis::FuncTable();
+    cached.type = 1;
+    ASSERT_EQ(0, cached.loadData(fileName, true));
+    checkEqual(cached);
+    // Changed data file is parsed and the cache is written again
+    content += "# changed\n";
+    std::ofstream(fileName, std::ios::binary) << content;
+    uint64_t changedHash = parfis::Global::hash(content.data(), content.size());
+    ASSERT_EQ(1, cached.readCache(cacheName, changedHash));
+    ASSERT_EQ(0, cached.loadData(fileName, true));
+    ASSERT_EQ(0, cached.readCache(cacheName, changedHash));
+    checkEqual(cached);
+    // Cache with a wrong checksum is not used
+    std::string cacheContent;
+    ASSERT_EQ(0, parfis::Global::readFile(cacheName, cacheContent));
+    cacheContent.back() ^= 1;
+    std::ofstream(cacheName, std::ios::binary) << cacheContent;
+    ASSERT_EQ(1, cached.readCache(cacheName, changedHash));
+    cached = parfis::FuncTable();
+    cached.type = 1;
+    ASSERT_EQ(0, cached.loadData(fileName, true));
+    checkEqual(cached);
+    std::remove(fileName.c_str());
+    std::remove(cacheName.c_str());
+}
+
+/**
+ * @brief Check that the Parfis objects share the cross section tables from 
+ * FuncTableRegistry, and the table is freed with the last object
+ */
+TEST(api, sharedCrossSection) {
+    std::string fileName = "./test_sharedCrossSection.csv";
+    std::string content;
+    ASSERT_EQ(0, parfis::Global::readFile("./data/cross_sections/simple_e.csv", content));
+    std::ofstream(fileName, std::ios::binary) << content;
+    size_t tableCnt = parfis::FuncTableRegistry::size();
+    uint32_t id[2];
+    for (int i = 0; i < 2; i++) {
+        id[i] = parfis::api::newParfis();
+        parfis::api::setConfigFromFile(id[i], 
+            "./data/config_files/test_physics_gasCollisionDefinition.ini");
+        parfis::api::setConfig(id[i], "particle.crossSectionCache = 0");
+        parfis::api::setConfig(id[i], 
+            ("particle.specie.a.gasCollision.elastic.crossSectionFile = \"" + fileName + 
+                "\"").c_str());
+        // Frequency depends on the gas, it is calculated for every object
+        parfis::api::setConfig(id[i], 
+            ("system.gas.bck.molDensity = " + std::to_string(0.1*(i + 1))).c_str());
+        parfis::api::loadCfgData(id[i]);
+        parfis::api::loadSimData(id[i]);
+    }
+    const parfis::GasCollision& gasColA = parfis::api::getSimData(id[0])->gasCollisionVec[0];
+    const parfis::GasCollision& gasColB = parfis::api::getSimData(id[1])->gasCollisionVec[0];
+    ASSERT_EQ(gasColA.xSecFtab.get(), gasColB.xSecFtab.get());
+    ASSERT_EQ(8000, gasColA.xSecFtab->xVec.size());
+    ASSERT_EQ(tableCnt + 1, parfis::FuncTableRegistry::size());
+    ASSERT_NEAR(2.0*gasColA.freqFtab.yVec.back(), gasColB.freqFtab.yVec.back(), 
+        1e-12*gasColB.freqFtab.yVec.back());
+    std::weak_ptr<const parfis::FuncTable> xSecFtab = gasColA.xSecFtab;
+    parfis::api::deleteParfis(id[0]);
+    ASSERT_FALSE(xSecFtab.expired());
+    parfis::api::deleteParfis(id[1]);
+    ASSERT_TRUE(xSecFtab.expired());
+    ASSERT_EQ(tableCnt, parfis::FuncTableRegistry::size());
+    std::remove(fileName.c_str());
+}
+
+/**
+ * @brief Check the constant time lookup of FuncTable against the binary search, 
+ * and the batch evaluation against the scalar one
+ */
+TEST(api, funcTableEval) {
+    uint32_t id = parfis::api::newParfis();
+    parfis::api::setConfigFromFile(id, "./data/config_files/test_physics_gasCollisionDefinition.ini");
+    parfis::api::loadCfgData(id);
+    parfis::api::loadSimData(id);
+    const parfis::SimData *pSimData = parfis::api::getSimData(id);
+    const parfis::FuncTable& xSecFtab = *pSimData->gasCollisionVec[0].xSecFtab;
+    const parfis::FuncTable& probFtab = 
+        pSimData->gasCollisionProbVec[pSimData->specieVec[0].gasCollisionProbId];
+    ASSERT_EQ(6, xSecFtab.idx.size());
+    ASSERT_EQ(1, xSecFtab.yStride);
+    ASSERT_EQ(2, probFtab.yStride);
+    std::mt19937_64 engine(1);
+    std::uniform_real_distribution<double> dist{0.0, 1.0};
+    for (const parfis::FuncTable* pft : {&xSecFtab, &probFtab}) {
+        // Values from every range, and out of the table
+        std::vector<double> xVec = {-1.0, pft->xVec.back(), 2.0*pft->xVec.back()};
+        for (size_t i = 0; i < 1001; i++)
+            xVec.push_back(pft->xVec.back()*pow(dist(engine), 4));
+        for (double x : xVec) {
+            auto it = std::upper_bound(pft->xVec.begin(), pft->xVec.end(), x);
+            size_t k = it == pft->xVec.begin() ? 0 : it - pft->xVec.begin() - 1;
+            ASSERT_EQ(k, pft->xIndex(x));
+        }
+        std::vector<double> yVec(xVec.size());
+        for (int col = 0; col < pft->yStride; col++) {
+            pft->evalBatch(xVec.data(), xVec.size(), yVec.data(), col);
+            for (size_t i = 0; i < xVec.size(); i++)
+                ASSERT_EQ(pft->eval(xVec[i], col), yVec[i]);
+        }
+    }
+    parfis::api::deleteParfis(id);
+}
+
+/**
+ * @brief Check the float collision table resampled from the collision probability table
+ */
+TEST(api, colProbTable) {
+    uint32_t id = parfis::api::newParfis();
+    parfis::api::setConfigFromFile(id, "./data/config_files/test_physics_gasCollisionDefinition.ini");
+    parfis::api::setConfig(id, "system.timestep = 1.4e-8");
+    parfis::api::setConfig(id, "system.gas.bck.molDensity = 1.4e-3");
+    parfis::api::setConfig(id, "particle.colTableBins = 64");
+    parfis::api::setConfig(id, "particle.colTableMaxError = 5e-3");
+    parfis::api::loadCfgData(id);
+    parfis::api::loadSimData(id);
+    const parfis::SimData *pSimData = parfis::api::getSimData(id);
+    const parfis::Specie& spec = pSimData->specieVec[0];
+    const parfis::FuncTable& probFtab = pSimData->gasCollisionProbVec[spec.gasCollisionProbId];
+    ASSERT_EQ(1, pSimData->colProbTableVec.size());
+    const parfis::ColProbTable& tab = pSimData->colProbTableVec[spec.gasCollisionProbId];
+    ASSERT_EQ(2, tab.colCnt);
+    ASSERT_EQ(2, tab.stride);
+    // Bins are doubled until the error is below colTableMaxError
+    ASSERT_EQ(128, tab.binCnt);
+    ASSERT_LE(tab.maxError, 5e-3);
+    ASSERT_EQ(0, reinterpret_cast<uintptr_t>(tab.prob.data()) % 64);
+    for (size_t k = 0; probFtab.xVec[k] <= 1.0; k++) {
+        const float* prob = tab.bin(probFtab.xVec[k]);
+        ASSERT_LE(prob[1], spec.maxColProb);
+        for (int col = 0; col < 2; col++)
+            ASSERT_NEAR(probFtab.yVec[2*k + col], prob[col], tab.maxError);
+    }
+    // Batch evaluation gives the same values as the bins
+    std::vector<double> xVec(1003), yVec(1003);
+    for (size_t i = 0; i < xVec.size(); i++)
+        xVec[i] = 1.1*i/xVec.size();
+    for (int col = 0; col < 2; col++) {
+        tab.evalBatch(xVec.data(), xVec.size(), yVec.data(), col);
+        for (size_t i = 0; i < xVec.size(); i++)
+            ASSERT_EQ(double(tab.bin(xVec[i])[col]), yVec[i]);
+    }
+    // Without the float tables
+    parfis::api::setConfig(id, "particle.colTableBins = 0");
+    parfis::api::loadCfgData(id);
+    parfis::api::loadSimData(id);
+    ASSERT_EQ(0, pSimData->colProbTableVec.size());
+    parfis::api::deleteParfis(id);
+}
+
+/**
+ * @brief Check that the alias tables give the collision probabilities of the rows, and 
+ * compare the time of the selection with the cumulative scan for 64 collisions
+ */
+TEST(api, colAliasTable) {
+    // Probability of every column from the alias table, relative to the total
+    auto aliasProb = [](const parfis::ColAliasTable& tab, int row) {
+        std::vector<double> prob(tab.colCnt, 0);
+        for (int i = 0; i < tab.colCnt; i++) {
+            const parfis::ColAliasTable::Entry& e = tab.entry[size_t(row)*tab.colCnt + i];
+            prob[i] += e.prob/tab.colCnt;
+            prob[e.alias] += (1.0 - e.prob)/tab.colCnt;
+        }
+        return prob;
+    };
+    for (int bins : {0, 64}) {
+        uint32_t id = parfis::api::newParfis();
+        parfis::api::setConfigFromFile(id, 
+            "./data/config_files/test_physics_gasCollisionDefinition.ini");
+        parfis::api::setConfig(id, ("particle.colTableBins = " + std::to_string(bins)).c_str());
+        parfis::api::loadCfgData(id);
+        parfis::api::loadSimData(id);
+        const parfis::SimData *pSimData = parfis::api::getSimData(id);
+        int probId = pSimData->specieVec[0].gasCollisionProbId;
+        const parfis::FuncTable& probFtab = pSimData->gasCollisionProbVec[probId];
+        const parfis::ColAliasTable& tab = pSimData->colAliasTableVec[probId];
+        ASSERT_EQ(2, tab.colCnt);
+        ASSERT_EQ(bins ? bins : probFtab.xVec.size(), tab.rowCnt);
+        for (int k = 0; k < tab.rowCnt; k++) {
+            std::vector<double> cumProb(tab.colCnt);
+            for (int j = 0; j < tab.colCnt; j++)
+                cumProb[j] = bins ? pSimData->colProbTableVec[probId].prob[
+                    k*pSimData->colProbTableVec[probId].stride + j] : 
+                    probFtab.yVec[k*probFtab.colCnt + j];
+            if (cumProb.back() <= 0) continue;
+            std::vector<double> prob = aliasProb(tab, k);
+            for (int j = 0; j < tab.colCnt; j++)
+                ASSERT_NEAR((cumProb[j] - (j ? cumProb[j - 1] : 0.0))/cumProb.back(), 
+                    prob[j], 1e-12);
+        }
+        parfis::api::deleteParfis(id);
+    }
+    // Table with 64 collisions and 1024 rows
+    int rowCnt = 1024, colCnt = 64;
+    parfis::FuncTable ftab;
+    ftab.xVec.resize(rowCnt);
+    ftab.yStride = colCnt;
+    ftab.yVec.resize(size_t(rowCnt)*colCnt);
+    std::mt19937_64 engine(1);
+    std::uniform_real_distribution<double> dist{0.0, 1.0};
+    for (int k = 0; k < rowCnt; k++)
+        for (int j = 0; j < colCnt; j++)
+            ftab.yVec[k*colCnt + j] = pow(dist(engine), 4) + (j ? ftab.yVec[k*colCnt + j - 1] : 0);
+    parfis::ColAliasTable tab;
+    tab.build(ftab);
+    for (int k = 0; k < rowCnt; k++) {
+        std::vector<double> prob = aliasProb(tab, k);
+        const double* cumProb = &ftab.yVec[k*colCnt];
+        for (int j = 0; j < colCnt; j++)
+            ASSERT_NEAR((cumProb[j] - (j ? cumProb[j - 1] : 0.0))/cumProb[colCnt - 1], 
+                prob[j], 1e-12);
+    }
+    size_t n = 1 << 20;
+    std::vector<int> rowVec(n);
+    std::vector<double> uVec(n);
+    for (size_t i = 0; i < n; i++) {
+        rowVec[i] = int(dist(engine)*rowCnt);
+        uVec[i] = dist(engine);
+    }
+    std::vector<size_t> scanCnt(colCnt, 0), aliasCnt(colCnt, 0);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++) {
+        const double* cumProb = &ftab.yVec[rowVec[i]*colCnt];
+        double r = uVec[i]*cumProb[colCnt - 1];
+        int j = 0;
+        while (r >= cumProb[j]) j++;
+        scanCnt[j]++;
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i++)
+        aliasCnt[tab.sample(rowVec[i], uVec[i])]++;
+    auto end = std::chrono::steady_clock::now();
+    double scanTime = std::chrono::duration<double, std::nano>(mid - start).count()/n;
+    double aliasTime = std::chrono::duration<double, std::nano>(end - mid).count()/n;
+    std::cout << GTEST_BOX << "selection of 1 of " << colCnt << " collisions, scan: " << 
+        scanTime << " ns, alias: " << aliasTime << " ns" << std::endl;
+    // Same distribution of the collisions over all rows
+    for (int j = 0; j < colCnt; j++)
+        ASSERT_NEAR(double(scanCnt[j]), double(aliasCnt[j]), 
+            5.0*sqrt(2.0*(scanCnt[j] + 1)));
+}
+
+/**
+ * @brief Check the Philox4x32-10 generator with the known answers from Random123, 
+ * and the random stream filled in blocks
+ */
+TEST(api, philoxRandomStream) {
+    struct KnownAnswer { uint32_t ctr[4]; uint32_t key[2]; uint32_t out[4]; };
+    KnownAnswer kaVec[3] = {
+        {{0, 0, 0, 0}, {0, 0}, {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}},
+        {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}, {0xffffffff, 0xffffffff}, 
+            {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}},
+        {{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0}, 
+            {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}};
+    for (auto& ka : kaVec) {
+        uint32_t out[4];
+        parfis::Philox::generate(ka.ctr, ka.key, out);
+        for (int i = 0; i < 4; i++)
+            ASSERT_EQ(ka.out[i], out[i]);
+    }
+    // Block fill gives the same numbers as single calls, also from an odd position
+    parfis::RandomStream rndA(12345, 1, 7, 3, parfis::RandomStreamId::FindColliders);
+    parfis::RandomStream rndB(12345, 1, 7, 3, parfis::RandomStreamId::FindColliders);
+    std::vector<double> blockVec(101);
+    rndA.uniform();
+    rndA.uniform(blockVec.data(), blockVec.size());
+    rndB.uniform();
+    for (auto& x : blockVec) {
+        ASSERT_EQ(rndB.uniform(), x);
+        ASSERT_GE(x, 0.0);
+        ASSERT_LT(x, 1.0);
+    }
+    // Streams of other steps and purposes differ
+    parfis::RandomStream rndC(12345, 1, 7, 4, parfis::RandomStreamId::FindColliders);
+    parfis::RandomStream rndD(12345, 1, 7, 3, parfis::RandomStreamId::ScatterColliders);
+    ASSERT_NE(blockVec[0], rndC.uniform());
+    ASSERT_NE(blockVec[0], rndD.uniform());
+}
+
+/**
+ * @brief Check simd::sincos against std::sin and std::cos
+ */
+TEST(api, simdSinCos) {
+    typedef parfis::simd::Pack<double> Pack;
+    std::vector<double> xVec(1001), sVec(1001 + Pack::width), cVec(1001 + Pack::width);
+    for (size_t i = 0; i < xVec.size(); i++)
+        xVec[i] = -M_PI + 2.0*M_PI*i/(xVec.size() - 1);
+    xVec.resize(sVec.size(), 0);
+    for (size_t i = 0; i + Pack::width <= xVec.size(); i += Pack::width) {
+        Pack s, c;
+        parfis::simd::sincos(Pack::load(xVec.data() + i), s, c);
+        s.store(sVec.data() + i);
+        c.store(cVec.data() + i);
+    }
+    for (size_t i = 0; i + Pack::width <= xVec.size(); i++) {
+        ASSERT_NEAR(std::sin(xVec[i]), sVec[i], 1e-13);
+        ASSERT_NEAR(std::cos(xVec[i]), cVec[i], 1e-13);
+    }
+}
+
 /**
  * @brief Check PyGasCollision and PyFuncTable in a structure
  */
@@ -447,4 +947,54 @@ TEST(api, structPyFuncTable) {
     ASSERT_EQ(8000, parfis::api::getPySimData(id)->pyGasCollisionProbVec.ptr[0].xVec.size);
     ASSERT_EQ(2*8000, parfis::api::getPySimData(id)->pyGasCollisionProbVec.ptr[0].yVec.size);
 }
+
+/// Evolve counts received by evolveStepsCallback
+static std::vector<uint64_t> s_evolveCntVec;
+
+/// Callback for api::evolveSteps that stops evolving after 15 steps
+static int evolveStepsCallback(uint32_t id, uint64_t evolveCnt)
+{
+    s_evolveCntVec.push_back(evolveCnt);
+    return evolveCnt >= 15 ? 1 : 0;
+}
+
+/**
+ * @brief Check that api::evolveSteps gives the same states as calling the evolve 
+ * command chain, and that the callback is called every k steps
+ */
+TEST(api, evolveSteps) {
+    uint32_t id[2];
+    for (int i = 0; i < 2; i++) {
+        id[i] = parfis::api::newParfis();
+        parfis::api::setConfig(id[i], "system.timestep = 1e-9");
+        parfis::api::setConfig(id[i], "system.geometrySize = [0.01, 0.01, 0.02]");
+        parfis::api::setConfig(id[i], "particle.specie.a.velInitDistMin = [-0.2, -0.2, -0.2]");
+        parfis::api::setConfig(id[i], "particle.specie.a.velInitDistMax = [0.2, 0.2, 0.2]");
+        parfis::api::setConfig(id[i], "particle.specie.a.randomSeed = 1");
+        parfis::api::loadCfgData(id[i]);
+        parfis::api::loadSimData(id[i]);
+        parfis::api::runCommandChain(id[i], "create");
+    }
+    for (int i = 0; i < 10; i++)
+        ASSERT_EQ(0, parfis::api::runCommandChain(id[0], "evolve"));
+    ASSERT_EQ(0, parfis::api::evolveSteps(id[1], 10));
+    const parfis::SimData *pSimData[2] = {
+        parfis::api::getSimData(id[0]), parfis::api::getSimData(id[1])};
+    ASSERT_EQ(pSimData[0]->evolveCnt, pSimData[1]->evolveCnt);
+    ASSERT_EQ(pSimData[0]->stateVec.size(), pSimData[1]->stateVec.size());
+    for (size_t j = 0; j < pSimData[0]->stateVec.size(); j++) {
+        ASSERT_EQ(pSimData[0]->stateVec[j].pos, pSimData[1]->stateVec[j].pos);
+        ASSERT_EQ(pSimData[0]->stateVec[j].vel, pSimData[1]->stateVec[j].vel);
+    }
+    // Callback every 5 steps, it stops evolving at evolveCnt 15
+    s_evolveCntVec.clear();
+    ASSERT_EQ(1, parfis::api::evolveSteps(id[1], 100, 5, evolveStepsCallback));
+    ASSERT_EQ(s_evolveCntVec, std::vector<uint64_t>({15}));
+    ASSERT_EQ(15, pSimData[1]->evolveCnt);
+    s_evolveCntVec.clear();
+    ASSERT_EQ(0, parfis::api::evolveSteps(id[0], 4, 2, evolveStepsCallback));
+    ASSERT_EQ(s_evolveCntVec, std::vector<uint64_t>({12, 14}));
+    parfis::api::deleteParfis(id[0]);
+    parfis::api::deleteParfis(id[1]);
+}
 /** @} gtestAll*/
@@ -8,6 +8,8 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <bitset>
+#include <array>
+#include <algorithm>
 /**
  * @addtogroup gtestAll
  * @{
@@ -114,4 +116,790 @@ TEST(physics, checkUniformField) {
     parfis::api::deleteParfis(id);
 }
 
+/**
+ * @brief Check that states stored as structure of arrays (stateLayout = 1) evolve 
+ * the same as states stored as array of structures (stateLayout = 0)
+ */
+TEST(physics, compareStateLayout) {
+    uint32_t id[2];
+    for (int i = 0; i < 2; i++) {
+        id[i] = parfis::api::newParfis();
+        parfis::api::setConfig(id[i], "system.timestep = 1e-9");
+        parfis::api::setConfig(id[i], "system.geometrySize = [0.01, 0.01, 0.02]");
+        parfis::api::setConfig(id[i], "system.field.typeE = [0, 0, 1]");
+        parfis::api::setConfig(id[i], "system.field.strengthE = [0, 0, 10000.0]");
+        parfis::api::setConfig(id[i], "particle.specie.a.velInitDistMin = [-0.2, -0.2, -0.2]");
+        parfis::api::setConfig(id[i], "particle.specie.a.velInitDistMax = [0.2, 0.2, 0.2]");
+        parfis::api::setConfig(id[i], "particle.specie.a.randomSeed = 1");
+        parfis::api::setConfig(id[i], ("particle.stateLayout = " + std::to_string(i)).c_str());
+        parfis::api::loadCfgData(id[i]);
+        parfis::api::loadSimData(id[i]);
+        parfis::api::runCommandChain(id[i], "create");
+    }
+    const parfis::SimData *pAoS = parfis::api::getSimData(id[0]);
+    const parfis::SimData *pSoA = parfis::api::getSimData(id[1]);
+    ASSERT_EQ(pSoA->stateVec.size(), 0);
+    ASSERT_EQ(pAoS->stateVec.size(), pSoA->stateSoA.size());
+    for (uint32_t i = 0; i<100; i++) {
+        parfis::api::runCommandChain(id[0], "evolve");
+        parfis::api::runCommandChain(id[1], "evolve");
+    }
+    // Map every state to its cell by following the cell lists
+    std::vector<parfis::cellId_t> cellAoS(pAoS->stateVec.size());
+    std::vector<parfis::cellId_t> cellSoA(pSoA->stateSoA.size());
+    parfis::stateId_t stateId;
+    for (auto& spec : pAoS->specieVec) {
+        for (parfis::cellId_t cellId = 0; cellId < pAoS->cellVec.size(); cellId++) {
+            stateId = pAoS->headIdVec[spec.headIdOffset + cellId];
+            while (stateId != parfis::Const::noStateId) {
+                cellAoS[stateId] = cellId;
+                stateId = pAoS->stateVec[stateId].next;
+            }
+            stateId = pSoA->headIdVec[spec.headIdOffset + cellId];
+            while (stateId != parfis::Const::noStateId) {
+                cellSoA[stateId] = cellId;
+                stateId = pSoA->stateSoA.next[stateId];
+            }
+        }
+    }
+    double tol = 1e-9;
+    for (size_t i = 0; i < pAoS->stateVec.size(); i++) {
+        parfis::State state = pSoA->stateSoA.getState(i);
+        ASSERT_EQ(cellAoS[i], cellSoA[i]);
+        ASSERT_NEAR(pAoS->stateVec[i].pos.x, state.pos.x, tol);
+        ASSERT_NEAR(pAoS->stateVec[i].pos.y, state.pos.y, tol);
+        ASSERT_NEAR(pAoS->stateVec[i].pos.z, state.pos.z, tol);
+        ASSERT_NEAR(pAoS->stateVec[i].vel.x, state.vel.x, tol);
+        ASSERT_NEAR(pAoS->stateVec[i].vel.y, state.vel.y, tol);
+        ASSERT_NEAR(pAoS->stateVec[i].vel.z, state.vel.z, tol);
+    }
+    parfis::api::deleteParfis(id[0]);
+    parfis::api::deleteParfis(id[1]);
+}
+
+/**
+ * @brief Check that states sorted in cell bins (stateLayout = 2) evolve the same as 
+ * states in cell lists (stateLayout = 0)
+ */
+TEST(physics, compareStateLayoutBinned) {
+    uint32_t id[2];
+    int layout[2] = {0, 2};
+    for (int i = 0; i < 2; i++) {
+        id[i] = parfis::api::newParfis();
+        parfis::api::setConfig(id[i], "system.timestep = 1e-9");
+        parfis::api::setConfig(id[i], "system.geometrySize = [0.01, 0.01, 0.02]");
+        parfis::api::setConfig(id[i], "system.field.typeE = [0, 0, 1]");
+        parfis::api::setConfig(id[i], "system.field.strengthE = [0, 0, 10000.0]");
+        parfis::api::setConfig(id[i], "particle.specie.a.velInitDistMin = [-0.2, -0.2, -0.2]");
+        parfis::api::setConfig(id[i], "particle.specie.a.velInitDistMax = [0.2, 0.2, 0.2]");
+        parfis::api::setConfig(id[i], "particle.specie.a.randomSeed = 1");
+        parfis::api::setConfig(id[i], "particle.rebinPeriod = 7");
+        parfis::api::setConfig(id[i], 
+            ("particle.stateLayout = " + std::to_string(layout[i])).c_str());
+        parfis::api::loadCfgData(id[i]);
+        parfis::api::loadSimData(id[i]);
+        parfis::api::runCommandChain(id[i], "create");
+    }
+    const parfis::SimData *pAoS = parfis::api::getSimData(id[0]);
+    const parfis::SimData *pBin = parfis::api::getSimData(id[1]);
+    ASSERT_EQ(pBin->binOffsetVec.size(), pBin->cellVec.size() + 1);
+    ASSERT_EQ(pBin->binOffsetVec.back(), pAoS->stateVec.size());
+    for (uint32_t i = 0; i<100; i++) {
+        parfis::api::runCommandChain(id[0], "evolve");
+        parfis::api::runCommandChain(id[1], "evolve");
+    }
+    // States are permuted by sorting, so compare sorted states of every cell
+    typedef std::array<double, 6> StateArr;
+    std::vector<std::vector<StateArr>> cellAoS(pAoS->cellVec.size());
+    std::vector<std::vector<StateArr>> cellBin(pBin->cellVec.size());
+    parfis::stateId_t stateId;
+    const parfis::State* pState;
+    for (parfis::cellId_t cellId = 0; cellId < pAoS->cellVec.size(); cellId++) {
+        stateId = pAoS->headIdVec[cellId];
+        while (stateId != parfis::Const::noStateId) {
+            pState = &pAoS->stateVec[stateId];
+            cellAoS[cellId].push_back({pState->pos.x, pState->pos.y, pState->pos.z, 
+                pState->vel.x, pState->vel.y, pState->vel.z});
+            stateId = pState->next;
+        }
+    }
+    const parfis::StateSoA& soa = pBin->stateSoA;
+    for (size_t i = 0; i < soa.size(); i++) {
+        cellBin[soa.cellId[i]].push_back({soa.posX[i], soa.posY[i], soa.posZ[i], 
+            soa.velX[i], soa.velY[i], soa.velZ[i]});
+    }
+    double tol = 1e-9;
+    for (parfis::cellId_t cellId = 0; cellId < pAoS->cellVec.size(); cellId++) {
+        ASSERT_EQ(cellAoS[cellId].size(), cellBin[cellId].size());
+        std::sort(cellAoS[cellId].begin(), cellAoS[cellId].end());
+        std::sort(cellBin[cellId].begin(), cellBin[cellId].end());
+        for (size_t i = 0; i < cellAoS[cellId].size(); i++)
+            for (size_t j = 0; j < 6; j++)
+                ASSERT_NEAR(cellAoS[cellId][i][j], cellBin[cellId][i][j], tol);
+    }
+    // Bins are sorted after the last rebin
+    for (parfis::cellId_t cellId = 0; cellId < pBin->cellVec.size(); cellId++)
+        ASSERT_LE(pBin->binOffsetVec[cellId], pBin->binOffsetVec[cellId + 1]);
+    parfis::api::deleteParfis(id[0]);
+    parfis::api::deleteParfis(id[1]);
+}
+
+/**
+ * @brief Check the uniform magnetic field, the rotation of velocity around the field 
+ * keeps the speed
+ */
+TEST(physics, checkUniformMagneticField) {
+    uint32_t id = parfis::api::newParfis();
+    parfis::api::setConfig(id, "system.timestep = 1e-9");
+    parfis::api::setConfig(id, "system.periodicBoundary = [0, 0, 1]");
+    parfis::api::setConfig(id, "system.field.typeB = [0, 0, 1]");
+    parfis::api::setConfig(id, "system.field.strengthB = [0, 0, 0.1]");
+    parfis::api::loadCfgData(id);
+    parfis::api::loadSimData(id);
+    parfis::api::runCommandChain(id, "create");
+    const parfis::SimData *pSimData = parfis::api::getSimData(id);
+    const parfis::Specie& spec = pSimData->specieVec[0];
+    const parfis::State& state = pSimData->stateVec[100];
+    double vxy = state.vel.x*state.vel.x + state.vel.y*state.vel.y;
+    double vz = state.vel.z;
+    parfis::Vec3D<double> prevVel = state.vel;
+    for (uint32_t i = 0; i<10; i++) {
+        parfis::api::runCommandChain(id, "evolve");
+        ASSERT_NE(prevVel, state.vel);
+        ASSERT_NEAR(vxy, state.vel.x*state.vel.x + state.vel.y*state.vel.y, 1e-12);
+        ASSERT_EQ(vz, state.vel.z);
+        prevVel = state.vel;
+    }
+    // Rotation vector t = q*B*dt/(2*m)
+    ASSERT_NEAR(spec.borisT.z, 0.5*spec.charge*0.1*spec.dt/spec.mass, 1e-15);
+    ASSERT_EQ(spec.borisT.x, 0.0);
+    parfis::api::deleteParfis(id);
+}
+
+/**
+ * @brief Check that the vectorized Boris push of the structure of arrays layout gives 
+ * the same states as the push of states in cell lists
+ */
+TEST(physics, compareMagneticFieldSoA) {
+    uint32_t id[2];
+    for (int i = 0; i < 2; i++) {
+        id[i] = parfis::api::newParfis();
+        parfis::api::setConfig(id[i], "system.timestep = 1e-9");
+        parfis::api::setConfig(id[i], "system.geometrySize = [0.01, 0.01, 0.02]");
+        parfis::api::setConfig(id[i], "system.periodicBoundary = [0, 0, 1]");
+        parfis::api::setConfig(id[i], "system.field.typeE = [0, 0, 1]");
+        parfis::api::setConfig(id[i], "system.field.strengthE = [0, 0, 100.0]");
+        parfis::api::setConfig(id[i], "system.field.typeB = [1, 0, 1]");
+        parfis::api::setConfig(id[i], "system.field.strengthB = [0.05, 0, 0.1]");
+        parfis::api::setConfig(id[i], "particle.specie.a.velInitDistMin = [-0.2, -0.2, -0.2]");
+        parfis::api::setConfig(id[i], "particle.specie.a.velInitDistMax = [0.2, 0.2, 0.2]");
+        parfis::api::setConfig(id[i], "particle.specie.a.randomSeed = 1");
+        parfis::api::setConfig(id[i], 
+            ("particle.stateLayout = " + std::to_string(i)).c_str());
+        parfis::api::loadCfgData(id[i]);
+        parfis::api::loadSimData(id[i]);
+        parfis::api::runCommandChain(id[i], "create");
+    }
+    const parfis::SimData *pAoS = parfis::api::getSimData(id[0]);
+    const parfis::SimData *pSoA = parfis::api::getSimData(id[1]);
+    ASSERT_NE(pAoS->specieVec[0].borisT.x, 0.0);
+    ASSERT_EQ(pAoS->specieVec[0].borisT, pSoA->specieVec[0].borisT);
+    ASSERT_EQ(0, parfis::api::evolveSteps(id[0], 50));
+    ASSERT_EQ(0, parfis::api::evolveSteps(id[1], 50));
+    ASSERT_EQ(pAoS->stateVec.size(), pSoA->stateSoA.size());
+    double tol = 1e-9;
+    for (size_t i = 0; i < pAoS->stateVec.size(); i++) {
+        parfis::State state = pSoA->stateSoA.getState(i);
+        ASSERT_NEAR(pAoS->stateVec[i].pos.x, state.pos.x, tol);
+        ASSERT_NEAR(pAoS->stateVec[i].pos.y, state.pos.y, tol);
+        ASSERT_NEAR(pAoS->stateVec[i].pos.z, state.pos.z, tol);
+        ASSERT_NEAR(pAoS->stateVec[i].vel.x, state.vel.x, tol);
+        ASSERT_NEAR(pAoS->stateVec[i].vel.y, state.vel.y, tol);
+        ASSERT_NEAR(pAoS->stateVec[i].vel.z, state.vel.z, tol);
+    }
+    parfis::api::deleteParfis(id[0]);
+    parfis::api::deleteParfis(id[1]);
+}
+
+/**
+ * @brief Check that pushing states with multiple threads (z-slabs) gives the same 
+ * states as pushing with one thread, for cell lists and cell bins
+ */
+TEST(physics, compareThreads) {
+    uint32_t id[2];
+    int threads[2] = {1, 4};
+    for (int layout : {0, 2}) {
+        for (int i = 0; i < 2; i++) {
+            id[i] = parfis::api::newParfis();
+            parfis::api::setConfig(id[i], "system.timestep = 1e-9");
+            parfis::api::setConfig(id[i], "system.geometrySize = [0.01, 0.01, 0.02]");
+            parfis::api::setConfig(id[i], "system.periodicBoundary = [0, 0, 1]");
+            parfis::api::setConfig(id[i], 
+                ("system.threads = " + std::to_string(threads[i])).c_str());
+            parfis::api::setConfig(id[i], 
+                "particle.specie.a.velInitDistMin = [-0.2, -0.2, -0.2]");
+            parfis::api::setConfig(id[i], 
+                "particle.specie.a.velInitDistMax = [0.2, 0.2, 0.2]");
+            parfis::api::setConfig(id[i], "particle.specie.a.randomSeed = 1");
+            parfis::api::setConfig(id[i], 
+                ("particle.stateLayout = " + std::to_string(layout)).c_str());
+            parfis::api::loadCfgData(id[i]);
+            parfis::api::loadSimData(id[i]);
+            parfis::api::runCommandChain(id[i], "create");
+        }
+        const parfis::SimData *pSimData[2] = {
+            parfis::api::getSimData(id[0]), parfis::api::getSimData(id[1])};
+        for (uint32_t i = 0; i<50; i++) {
+            parfis::api::runCommandChain(id[0], "evolve");
+            parfis::api::runCommandChain(id[1], "evolve");
+        }
+        // Map every state to its cell
+        std::vector<parfis::cellId_t> cellMap[2];
+        std::vector<parfis::State> stateVec[2];
+        parfis::stateId_t stateId;
+        for (int i = 0; i < 2; i++) {
+            if (layout == 0) {
+                stateVec[i] = pSimData[i]->stateVec;
+                cellMap[i].resize(stateVec[i].size());
+                for (parfis::cellId_t cellId = 0; cellId < pSimData[i]->cellVec.size(); cellId++) {
+                    stateId = pSimData[i]->headIdVec[cellId];
+                    while (stateId != parfis::Const::noStateId) {
+                        cellMap[i][stateId] = cellId;
+                        stateId = stateVec[i][stateId].next;
+                    }
+                }
+            }
+            else {
+                for (size_t j = 0; j < pSimData[i]->stateSoA.size(); j++) {
+                    stateVec[i].push_back(pSimData[i]->stateSoA.getState(j));
+                    cellMap[i].push_back(pSimData[i]->stateSoA.cellId[j]);
+                }
+            }
+        }
+        ASSERT_EQ(stateVec[0].size(), stateVec[1].size());
+        for (size_t j = 0; j < stateVec[0].size(); j++) {
+            ASSERT_EQ(cellMap[0][j], cellMap[1][j]);
+            ASSERT_EQ(stateVec[0][j].pos, stateVec[1][j].pos);
+            ASSERT_EQ(stateVec[0][j].vel, stateVec[1][j].vel);
+        }
+        parfis::api::deleteParfis(id[0]);
+        parfis::api::deleteParfis(id[1]);
+    }
+}
+
+/**
+ * @brief Check the wall reflection of fast states in a small geometry, for all state 
+ * layouts. States must stay inside the cylinder and keep their kinetic energy.
+ */
+TEST(physics, checkFastWallReflection) {
+    for (int layout = 0; layout < 3; layout++) {
+        uint32_t id = parfis::api::newParfis();
+        parfis::api::setConfig(id, "system.timestep = 1e-9");
+        parfis::api::setConfig(id, "system.geometrySize = [0.01, 0.01, 0.02]");
+        parfis::api::setConfig(id, "system.field.typeE = [0, 0, 0]");
+        parfis::api::setConfig(id, "particle.specie.a.velInitDistMin = [-0.7, -0.7, -0.7]");
+        parfis::api::setConfig(id, "particle.specie.a.velInitDistMax = [0.7, 0.7, 0.7]");
+        parfis::api::setConfig(id, "particle.specie.a.randomSeed = 1");
+        parfis::api::setConfig(id, 
+            ("particle.stateLayout = " + std::to_string(layout)).c_str());
+        parfis::api::loadCfgData(id);
+        parfis::api::loadSimData(id);
+        parfis::api::runCommandChain(id, "create");
+        const parfis::SimData *pSimData = parfis::api::getSimData(id);
+        const parfis::CfgData *pCfgData = parfis::api::getCfgData(id);
+        double radiusSquared = 0.25*pCfgData->cellCount.x*pCfgData->cellCount.x;
+        // States with their cells, in the order of ids
+        auto getStates = [&](std::vector<parfis::State>& stateVec, 
+            std::vector<parfis::cellId_t>& cellVec) {
+            stateVec.clear();
+            cellVec.clear();
+            if (layout == 0)
+                stateVec = pSimData->stateVec;
+            else
+                for (size_t j = 0; j < pSimData->stateSoA.size(); j++)
+                    stateVec.push_back(pSimData->stateSoA.getState(j));
+            cellVec.resize(stateVec.size());
+            if (layout == 2) {
+                for (size_t j = 0; j < cellVec.size(); j++)
+                    cellVec[j] = pSimData->stateSoA.cellId[j];
+                return;
+            }
+            for (parfis::cellId_t cellId = 0; cellId < pSimData->cellVec.size(); cellId++) {
+                parfis::stateId_t stateId = pSimData->headIdVec[cellId];
+                while (stateId != parfis::Const::noStateId) {
+                    cellVec[stateId] = cellId;
+                    stateId = stateVec[stateId].next;
+                }
+            }
+        };
+        std::vector<parfis::State> initVec, stateVec;
+        std::vector<parfis::cellId_t> cellVec;
+        getStates(initVec, cellVec);
+        for (uint32_t i = 0; i < 100; i++)
+            parfis::api::runCommandChain(id, "evolve");
+        getStates(stateVec, cellVec);
+        ASSERT_EQ(initVec.size(), stateVec.size());
+        double energy = 0.0;
+        double initEnergy = 0.0;
+        for (size_t j = 0; j < stateVec.size(); j++) {
+            const parfis::State& state = stateVec[j];
+            const parfis::Cell& cell = pSimData->cellVec[cellVec[j]];
+            ASSERT_TRUE(state.pos.x >= 0.0 && state.pos.x <= 1.0);
+            ASSERT_TRUE(state.pos.y >= 0.0 && state.pos.y <= 1.0);
+            ASSERT_TRUE(state.pos.z >= 0.0 && state.pos.z <= 1.0);
+            double rx = state.pos.x + cell.pos.x - 0.5*pCfgData->cellCount.x;
+            double ry = state.pos.y + cell.pos.y - 0.5*pCfgData->cellCount.y;
+            ASSERT_LE(rx*rx + ry*ry, radiusSquared*1.00001);
+            energy += 
+                state.vel.x*state.vel.x + state.vel.y*state.vel.y + state.vel.z*state.vel.z;
+            initEnergy += initVec[j].vel.x*initVec[j].vel.x + 
+                initVec[j].vel.y*initVec[j].vel.y + initVec[j].vel.z*initVec[j].vel.z;
+        }
+        // Binned states are reordered, so the kinetic energy of all states is compared
+        ASSERT_NEAR(energy/initEnergy, 1.0, 1e-9);
+        parfis::api::deleteParfis(id);
+    }
+}
+
+/**
+ * @brief Check that a specie with timestepRatio = 4 is pushed every fourth step, the 
+ * same as a specie with four times longer system timestep
+ */
+TEST(physics, checkSubcycling) {
+    uint32_t id[2];
+    const char* timestep[2] = {"system.timestep = 1e-9", "system.timestep = 4e-9"};
+    const char* ratio[2] = {
+        "particle.specie.a.timestepRatio = 4", "particle.specie.a.timestepRatio = 1"};
+    for (int i = 0; i < 2; i++) {
+        id[i] = parfis::api::newParfis();
+        parfis::api::setConfig(id[i], timestep[i]);
+        parfis::api::setConfig(id[i], ratio[i]);
+        parfis::api::setConfig(id[i], "system.geometrySize = [0.01, 0.01, 0.02]");
+        parfis::api::setConfig(id[i], "system.field.typeE = [0, 0, 1]");
+        parfis::api::setConfig(id[i], "system.field.strengthE = [0, 0, 10.0]");
+        parfis::api::setConfig(id[i], "particle.specie.a.velInitDistMin = [-0.2, -0.2, -0.2]");
+        parfis::api::setConfig(id[i], "particle.specie.a.velInitDistMax = [0.2, 0.2, 0.2]");
+        parfis::api::setConfig(id[i], "particle.specie.a.randomSeed = 1");
+        parfis::api::loadCfgData(id[i]);
+        parfis::api::loadSimData(id[i]);
+        parfis::api::runCommandChain(id[i], "create");
+    }
+    const parfis::SimData *pSimData[2] = {
+        parfis::api::getSimData(id[0]), parfis::api::getSimData(id[1])};
+    ASSERT_EQ(pSimData[0]->specieVec[0].dt, pSimData[1]->specieVec[0].dt);
+    for (uint32_t i = 0; i < 10; i++) {
+        for (int j = 0; j < 4; j++)
+            parfis::api::runCommandChain(id[0], "evolve");
+        parfis::api::runCommandChain(id[1], "evolve");
+    }
+    // The first step of id[0] pushes, the next three only count
+    parfis::api::runCommandChain(id[0], "evolve");
+    parfis::api::runCommandChain(id[1], "evolve");
+    for (int j = 0; j < 3; j++)
+        parfis::api::runCommandChain(id[0], "evolve");
+    ASSERT_NE(pSimData[0]->specieVec[0].dvUniformE.z, 0.0);
+    ASSERT_EQ(pSimData[0]->specieVec[0].dvUniformE, pSimData[1]->specieVec[0].dvUniformE);
+    ASSERT_EQ(pSimData[0]->stateVec.size(), pSimData[1]->stateVec.size());
+    for (size_t j = 0; j < pSimData[0]->stateVec.size(); j++) {
+        ASSERT_EQ(pSimData[0]->stateVec[j].pos, pSimData[1]->stateVec[j].pos);
+        ASSERT_EQ(pSimData[0]->stateVec[j].vel, pSimData[1]->stateVec[j].vel);
+    }
+    parfis::api::deleteParfis(id[0]);
+    parfis::api::deleteParfis(id[1]);
+}
+
+/**
+ * @brief Check the null-collision step (collideStates) against the collision 
+ * probability table
+ * @details Only collisions change the velocity, so the number of states with changed 
+ * velocity is compared to the sum of the total collision probabilities of all states. 
+ * Elastic collisions keep the speed and inelastic collisions decrease the energy by 
+ * the threshold. All state layouts give the same states.
+ */
+TEST(physics, checkNullCollision) {
+    uint32_t id[3];
+    for (int i = 0; i < 3; i++) {
+        id[i] = parfis::api::newParfis();
+        parfis::api::setConfigFromFile(id[i], 
+            "./data/config_files/test_physics_gasCollisionDefinition.ini");
+        parfis::api::setConfig(id[i], "system.timestep = 1.4e-8");
+        parfis::api::setConfig(id[i], "system.geometrySize = [0.01, 0.01, 0.02]");
+        parfis::api::setConfig(id[i], "system.gas.bck.molDensity = 1.4e-3");
+        parfis::api::setConfig(id[i], "particle.specie.a.statesPerCell = 100");
+        parfis::api::setConfig(id[i], "particle.specie.a.randomSeed = 1");
+        parfis::api::setConfig(id[i], ("particle.stateLayout = " + std::to_string(i)).c_str());
+        parfis::api::setConfig(id[i], "commandChain.evolve = [collideStates]");
+        parfis::api::loadCfgData(id[i]);
+        parfis::api::loadSimData(id[i]);
+        parfis::api::runCommandChain(id[i], "create");
+    }
+    const parfis::SimData *pSimData = parfis::api::getSimData(id[0]);
+    const parfis::Specie& spec = pSimData->specieVec[0];
+    const parfis::FuncTable& probFtab = pSimData->gasCollisionProbVec[spec.gasCollisionProbId];
+    ASSERT_GT(spec.maxColProb, 0.0);
+    ASSERT_LT(spec.maxColProb, 1.0);
+    const parfis::GasCollision& elastic = 
+        pSimData->gasCollisionVec[spec.gasCollisionVecId[0]];
+    const parfis::GasCollision& inelastic = 
+        pSimData->gasCollisionVec[spec.gasCollisionVecId[1]];
+    // Specie and gas have the same mass, reduced mass is half of the specie mass
+    double thresholdSq = 
+        4.0*inelastic.threshold*parfis::Const::eVJ/spec.mass/(spec.maxVel*spec.maxVel);
+    ASSERT_GT(thresholdSq, 0.0);
+    ASSERT_NEAR(inelastic.lossSq, thresholdSq, 1e-12);
+    ASSERT_EQ(0.0, elastic.lossSq);
+    ASSERT_NEAR(0.5, elastic.massRatio, 1e-15);
+    std::vector<parfis::State> stateVec = pSimData->stateVec;
+    double expected = 0;
+    for (auto& state : stateVec) {
+        double velSq = state.vel.x*state.vel.x + state.vel.y*state.vel.y + 
+            state.vel.z*state.vel.z;
+        expected += probFtab.yVec[probFtab.colCnt*probFtab.xIndex(velSq) + probFtab.colCnt - 1];
+    }
+    for (int i = 0; i < 3; i++)
+        parfis::api::runCommandChain(id[i], "evolve");
+    // Relative velocity in the center of mass frame keeps the speed for the elastic 
+    // collision, and loses thresholdSq for the inelastic collision
+    size_t elasticCnt = 0, inelasticCnt = 0;
+    for (size_t j = 0; j < stateVec.size(); j++) {
+        const parfis::State& state = pSimData->stateVec[j];
+        if (state.vel == stateVec[j].vel) continue;
+        double velSq0 = stateVec[j].vel.x*stateVec[j].vel.x + 
+            stateVec[j].vel.y*stateVec[j].vel.y + stateVec[j].vel.z*stateVec[j].vel.z;
+        parfis::Vec3D<double> relVel = {
+            state.vel.x - 0.5*stateVec[j].vel.x,
+            state.vel.y - 0.5*stateVec[j].vel.y,
+            state.vel.z - 0.5*stateVec[j].vel.z};
+        double relVelSq = 4.0*(relVel.x*relVel.x + relVel.y*relVel.y + relVel.z*relVel.z);
+        if (std::abs(relVelSq - velSq0) < 1e-12)
+            elasticCnt++;
+        else {
+            // Relative velocity stops if it is below the threshold
+            ASSERT_NEAR(velSq0 - relVelSq, std::min(velSq0, thresholdSq), 1e-12);
+            inelasticCnt++;
+        }
+    }
+    ASSERT_GT(elasticCnt, 0);
+    ASSERT_GT(inelasticCnt, 0);
+    ASSERT_NEAR(double(elasticCnt + inelasticCnt), expected, 5.0*sqrt(expected));
+    for (int i = 1; i < 3; i++) {
+        const parfis::SimData *pSimDataSoA = parfis::api::getSimData(id[i]);
+        ASSERT_EQ(stateVec.size(), pSimDataSoA->stateSoA.size());
+        for (size_t j = 0; j < stateVec.size(); j++)
+            ASSERT_EQ(pSimData->stateVec[j].vel, pSimDataSoA->stateSoA.getState(j).vel);
+    }
+    for (int i = 0; i < 3; i++)
+        parfis::api::deleteParfis(id[i]);
+}
+
+/**
+ * @brief Check the deflection angles sampled from GasCollision::scatterAngle, the 
+ * elastic collision with the heavy gas deflects the velocity uniformly in cosine 
+ * between 0 and 60 degrees
+ */
+TEST(physics, checkScatterAngle) {
+    uint32_t id = parfis::api::newParfis();
+    parfis::api::setConfigFromFile(id, 
+        "./data/config_files/test_physics_gasCollisionDefinition.ini");
+    parfis::api::setConfig(id, "system.timestep = 1.4e-8");
+    parfis::api::setConfig(id, "system.geometrySize = [0.01, 0.01, 0.02]");
+    parfis::api::setConfig(id, "system.gas.bck.molDensity = 1.4e-3");
+    parfis::api::setConfig(id, "system.gas.bck.amuMass = 4e9");
+    parfis::api::setConfig(id, "particle.specie.a.statesPerCell = 100");
+    parfis::api::setConfig(id, "particle.specie.a.randomSeed = 1");
+    parfis::api::setConfig(id, "particle.stateLayout = 1");
+    parfis::api::setConfig(id, 
+        "particle.specie.a.gasCollision.elastic.scatterAngle = [0, 1.0471975511965976] <double>");
+    parfis::api::setConfig(id, "commandChain.evolve = [collideStates]");
+    parfis::api::loadCfgData(id);
+    parfis::api::loadSimData(id);
+    parfis::api::runCommandChain(id, "create");
+    const parfis::SimData *pSimData = parfis::api::getSimData(id);
+    const parfis::Specie& spec = pSimData->specieVec[0];
+    const parfis::GasCollision& elastic = 
+        pSimData->gasCollisionVec[spec.gasCollisionVecId[0]];
+    ASSERT_EQ(2, elastic.scatterAngle.size());
+    ASSERT_EQ(4, spec.scatterCosVec.size());
+    parfis::StateSoA stateSoA = pSimData->stateSoA;
+    parfis::api::runCommandChain(id, "evolve");
+    size_t elasticCnt = 0;
+    double cosSum = 0, cosMin = 1;
+    for (size_t j = 0; j < stateSoA.size(); j++) {
+        parfis::Vec3D<double> vel0 = stateSoA.getState(j).vel;
+        parfis::Vec3D<double> vel = pSimData->stateSoA.getState(j).vel;
+        if (vel == vel0) continue;
+        double velSq0 = vel0.x*vel0.x + vel0.y*vel0.y + vel0.z*vel0.z;
+        double velSq = vel.x*vel.x + vel.y*vel.y + vel.z*vel.z;
+        // Gas particle is much heavier, speed is not changed by the elastic collision
+        if (std::abs(velSq - velSq0) > 1e-8) continue;
+        double cosChi = (vel.x*vel0.x + vel.y*vel0.y + vel.z*vel0.z)/velSq0;
+        cosSum += cosChi;
+        cosMin = std::min(cosMin, cosChi);
+        elasticCnt++;
+    }
+    ASSERT_GT(elasticCnt, 1000);
+    ASSERT_GT(cosMin, 0.5 - 1e-8);
+    // Cosine is uniform in [0.5, 1], standard deviation is 0.5/sqrt(12)
+    ASSERT_NEAR(0.75, cosSum/elasticCnt, 5.0*0.5/sqrt(12.0*elasticCnt));
+    parfis::api::deleteParfis(id);
+}
+
+/**
+ * @brief Check that the collisions give the same velocities for any number of threads
+ */
+TEST(physics, checkCollisionThreads) {
+    int threadsVec[2] = {1, 3};
+    uint32_t id[2];
+    for (int i = 0; i < 2; i++) {
+        id[i] = parfis::api::newParfis();
+        parfis::api::setConfigFromFile(id[i], 
+            "./data/config_files/test_physics_gasCollisionDefinition.ini");
+        parfis::api::setConfig(id[i], "system.timestep = 1.4e-8");
+        parfis::api::setConfig(id[i], "system.geometrySize = [0.01, 0.01, 0.02]");
+        parfis::api::setConfig(id[i], "system.gas.bck.molDensity = 1.4e-3");
+        parfis::api::setConfig(id[i], 
+            ("system.threads = " + std::to_string(threadsVec[i])).c_str());
+        parfis::api::setConfig(id[i], "particle.specie.a.statesPerCell = 100");
+        parfis::api::setConfig(id[i], "particle.specie.a.randomSeed = 1");
+        parfis::api::setConfig(id[i], "particle.stateLayout = 0");
+        parfis::api::setConfig(id[i], "commandChain.evolve = [collideStates]");
+        parfis::api::loadCfgData(id[i]);
+        parfis::api::loadSimData(id[i]);
+        parfis::api::runCommandChain(id[i], "create");
+        for (int j = 0; j < 3; j++)
+            parfis::api::runCommandChain(id[i], "evolve");
+    }
+    const parfis::SimData *pSimDataA = parfis::api::getSimData(id[0]);
+    const parfis::SimData *pSimDataB = parfis::api::getSimData(id[1]);
+    ASSERT_EQ(pSimDataA->stateVec.size(), pSimDataB->stateVec.size());
+    // More states than in one chunk of Particle::collisionChunk states
+    ASSERT_GT(pSimDataA->stateVec.size(), 4096);
+    for (size_t j = 0; j < pSimDataA->stateVec.size(); j++)
+        ASSERT_EQ(pSimDataA->stateVec[j].vel, pSimDataB->stateVec[j].vel);
+    for (int i = 0; i < 2; i++)
+        parfis::api::deleteParfis(id[i]);
+}
+
+/**
+ * @brief Check the null-collision step with the float collision tables, the number of 
+ * collisions is compared to the sum of the total collision probabilities from the table
+ */
+TEST(physics, checkNullCollisionFloatTable) {
+    uint32_t id = parfis::api::newParfis();
+    parfis::api::setConfigFromFile(id, 
+        "./data/config_files/test_physics_gasCollisionDefinition.ini");
+    parfis::api::setConfig(id, "system.timestep = 1.4e-8");
+    parfis::api::setConfig(id, "system.geometrySize = [0.01, 0.01, 0.02]");
+    parfis::api::setConfig(id, "system.gas.bck.molDensity = 1.4e-3");
+    parfis::api::setConfig(id, "particle.specie.a.statesPerCell = 100");
+    parfis::api::setConfig(id, "particle.specie.a.randomSeed = 1");
+    parfis::api::setConfig(id, "particle.stateLayout = 1");
+    parfis::api::setConfig(id, "particle.colTableBins = 1024");
+    parfis::api::setConfig(id, "commandChain.evolve = [collideStates]");
+    parfis::api::loadCfgData(id);
+    parfis::api::loadSimData(id);
+    parfis::api::runCommandChain(id, "create");
+    const parfis::SimData *pSimData = parfis::api::getSimData(id);
+    const parfis::Specie& spec = pSimData->specieVec[0];
+    const parfis::ColProbTable& tab = pSimData->colProbTableVec[spec.gasCollisionProbId];
+    parfis::StateSoA stateSoA = pSimData->stateSoA;
+    double expected = 0;
+    for (size_t j = 0; j < stateSoA.size(); j++) {
+        parfis::State state = stateSoA.getState(j);
+        expected += tab.bin(state.vel.x*state.vel.x + state.vel.y*state.vel.y + 
+            state.vel.z*state.vel.z)[tab.colCnt - 1];
+    }
+    parfis::api::runCommandChain(id, "evolve");
+    size_t colCnt = 0;
+    for (size_t j = 0; j < stateSoA.size(); j++)
+        if (pSimData->stateSoA.getState(j).vel != stateSoA.getState(j).vel)
+            colCnt++;
+    ASSERT_NEAR(double(colCnt), expected, 5.0*sqrt(expected));
+    parfis::api::deleteParfis(id);
+}
+
+/**
+ * @brief Check the collision counters, real collisions per energy bin are compared to 
+ * the states that changed velocity, and the energy loss to the change of the energy
+ */
+TEST(physics, checkCollisionCounter) {
+    uint32_t id = parfis::api::newParfis();
+    parfis::api::setConfigFromFile(id, 
+        "./data/config_files/test_physics_gasCollisionDefinition.ini");
+    parfis::api::setConfig(id, "system.timestep = 1.4e-8");
+    parfis::api::setConfig(id, "system.geometrySize = [0.01, 0.01, 0.02]");
+    parfis::api::setConfig(id, "system.gas.bck.molDensity = 1.4e-3");
+    parfis::api::setConfig(id, "system.threads = 3");
+    parfis::api::setConfig(id, "particle.specie.a.statesPerCell = 100");
+    parfis::api::setConfig(id, "particle.specie.a.randomSeed = 1");
+    parfis::api::setConfig(id, "particle.stateLayout = 0");
+    parfis::api::setConfig(id, "particle.collisionCounterBins = 8");
+    parfis::api::setConfig(id, "commandChain.evolve = [collideStates]");
+    parfis::api::loadCfgData(id);
+    parfis::api::loadSimData(id);
+    parfis::api::runCommandChain(id, "create");
+    const parfis::SimData *pSimData = parfis::api::getSimData(id);
+    const parfis::CfgData *pCfgData = parfis::api::getCfgData(id);
+    const parfis::Specie& spec = pSimData->specieVec[0];
+    const parfis::CollisionCounter& counter = pSimData->collisionCounter;
+    ASSERT_EQ(counter.binCnt, 8);
+    ASSERT_EQ(counter.collisionCntVec.size(), pSimData->gasCollisionVec.size()*8);
+    double minCellSize = std::min(pCfgData->cellSize.z, 
+        std::min(pCfgData->cellSize.x, pCfgData->cellSize.y));
+    parfis::Vec3D<double> velScale = {pCfgData->cellSize.x/minCellSize, 
+        pCfgData->cellSize.y/minCellSize, pCfgData->cellSize.z/minCellSize};
+    auto velSq = [&](const parfis::Vec3D<parfis::state_t>& v) {
+        return v.x*velScale.x*v.x*velScale.x + v.y*velScale.y*v.y*velScale.y + 
+            v.z*velScale.z*v.z*velScale.z;
+    };
+    std::vector<parfis::State> stateVec = pSimData->stateVec;
+    parfis::api::runCommandChain(id, "evolve");
+    std::vector<uint64_t> binCnt(8, 0);
+    double energyLoss = 0;
+    double energyLossAbs = 0;
+    for (size_t j = 0; j < stateVec.size(); j++) {
+        if (pSimData->stateVec[j].vel == stateVec[j].vel) continue;
+        double velSq0 = velSq(stateVec[j].vel);
+        binCnt[counter.bin(velSq0)]++;
+        energyLoss += spec.maxEv*(velSq0 - velSq(pSimData->stateVec[j].vel));
+        energyLossAbs += spec.maxEv*(velSq0 + velSq(pSimData->stateVec[j].vel));
+    }
+    uint64_t nullCnt = 0;
+    double counterEnergyLoss = 0;
+    for (int b = 0; b < 8; b++) {
+        uint64_t colCnt = 0;
+        for (auto colId : spec.gasCollisionVecId)
+            colCnt += counter.collisionCntVec[colId*8 + b];
+        ASSERT_EQ(colCnt, binCnt[b]);
+        nullCnt += counter.nullCollisionCntVec[spec.id*8 + b];
+    }
+    for (double loss : counter.energyLossVec)
+        counterEnergyLoss += loss;
+    ASSERT_GT(counterEnergyLoss, 0);
+    ASSERT_NEAR(counterEnergyLoss, energyLoss, 1e-5*energyLossAbs);
+    // Candidates are the null and the real collisions
+    double candidateCnt = double(nullCnt);
+    for (uint64_t cnt : binCnt)
+        candidateCnt += double(cnt);
+    double expected = spec.maxColProb*stateVec.size();
+    ASSERT_NEAR(candidateCnt, expected, 5.0*sqrt(expected));
+    parfis::api::resetCollisionCounter(id);
+    for (uint64_t cnt : counter.collisionCntVec)
+        ASSERT_EQ(cnt, 0);
+    for (uint64_t cnt : counter.nullCollisionCntVec)
+        ASSERT_EQ(cnt, 0);
+    parfis::api::deleteParfis(id);
+}
+
+/**
+ * @brief Check the collisions with maximal collision probabilities that are too small 
+ * for log(1 - maxColProb)
+ * @details With the thin gas the probability is below the precision of 1 - maxColProb, 
+ * so no state is expected to be a candidate. With the thinnest gas the skip between the 
+ * candidates overflows and every state must be a candidate with the null collision. No 
+ * velocity may change.
+ */
+TEST(physics, checkSmallCollisionProbability) {
+    const char* molDensity[2] = {"1.4e-20", "1e-312"};
+    for (int c = 0; c < 2; c++) {
+        uint32_t id = parfis::api::newParfis();
+        parfis::api::setConfigFromFile(id, 
+            "./data/config_files/test_physics_gasCollisionDefinition.ini");
+        parfis::api::setConfig(id, "system.timestep = 1.4e-8");
+        parfis::api::setConfig(id, "system.geometrySize = [0.01, 0.01, 0.02]");
+        parfis::api::setConfig(id, 
+            (std::string("system.gas.bck.molDensity = ") + molDensity[c]).c_str());
+        parfis::api::setConfig(id, "particle.specie.a.randomSeed = 1");
+        parfis::api::setConfig(id, "commandChain.evolve = [collideStates]");
+        parfis::api::loadCfgData(id);
+        parfis::api::loadSimData(id);
+        parfis::api::runCommandChain(id, "create");
+        const parfis::SimData *pSimData = parfis::api::getSimData(id);
+        const parfis::Specie& spec = pSimData->specieVec[0];
+        ASSERT_GT(spec.maxColProb, 0.0);
+        ASSERT_EQ(log(1.0 - spec.maxColProb), 0.0);
+        std::vector<parfis::State> stateVec = pSimData->stateVec;
+        parfis::api::runCommandChain(id, "evolve");
+        uint64_t nullCnt = 0;
+        for (uint64_t cnt : pSimData->collisionCounter.nullCollisionCntVec)
+            nullCnt += cnt;
+        ASSERT_EQ(nullCnt, c == 0 ? 0 : stateVec.size());
+        for (size_t j = 0; j < stateVec.size(); j++)
+            ASSERT_EQ(pSimData->stateVec[j].vel, stateVec[j].vel);
+        parfis::api::deleteParfis(id);
+    }
+}
+
+/**
+ * @brief Check the box geometry with the periodic boundary in x and z, and the wall in y
+ * @details Without the field, states move along straight lines that are wrapped by the 
+ * periodic boundary and folded by the wall, so the positions and velocities after the 
+ * push are compared with the ones computed from the initial states. Sorting in bins is 
+ * turned off, so the state ids don't change.
+ */
+TEST(physics, checkBoxGeometry) {
+    uint32_t id = parfis::api::newParfis();
+    parfis::api::setConfig(id, "system.geometry = 0");
+    parfis::api::setConfig(id, "system.geometrySize = [0.005, 0.006, 0.007]");
+    parfis::api::setConfig(id, "system.periodicBoundary = [1, 0, 1]");
+    parfis::api::setConfig(id, "system.threads = 3");
+    parfis::api::setConfig(id, "particle.specie.a.randomSeed = 1");
+    parfis::api::setConfig(id, "particle.rebinPeriod = 1000");
+    parfis::api::setConfig(id, "commandChain.evolve = [pushStates]");
+    parfis::api::loadCfgData(id);
+    parfis::api::loadSimData(id);
+    parfis::api::runCommandChain(id, "create");
+    const parfis::CfgData *pCfgData = parfis::api::getCfgData(id);
+    const parfis::SimData *pSimData = parfis::api::getSimData(id);
+    const parfis::StateSoA& soa = pSimData->stateSoA;
+    // All cells are full and all states are created
+    ASSERT_EQ(pCfgData->stateLayout, parfis::StateLayout::Binned);
+    ASSERT_EQ(pSimData->cellVec.size(), 5*6*7);
+    ASSERT_EQ(pSimData->cellIdAVec.size(), 3*4*5);
+    ASSERT_EQ(soa.size(), 5*6*7*10);
+    for (parfis::cellId_t cellId = 0; cellId < pSimData->cellVec.size(); cellId++)
+        ASSERT_EQ(pSimData->cellIndex.cellId(pSimData->cellVec[cellId].pos), cellId);
+    typedef std::array<double, 3> Vec;
+    std::vector<Vec> pos0(soa.size()), vel0(soa.size());
+    for (size_t i = 0; i < soa.size(); i++) {
+        const parfis::Vec3D<parfis::cellPos_t>& cellPos = pSimData->cellVec[soa.cellId[i]].pos;
+        pos0[i] = {cellPos.x + soa.posX[i], cellPos.y + soa.posY[i], cellPos.z + soa.posZ[i]};
+        vel0[i] = {soa.velX[i], soa.velY[i], soa.velZ[i]};
+    }
+    int steps = 40;
+    for (int i = 0; i < steps; i++)
+        parfis::api::runCommandChain(id, "evolve");
+    ASSERT_EQ(soa.size(), 5*6*7*10);
+    double count[3] = {5, 6, 7};
+    int periodic[3] = {1, 0, 1};
+    double tol = 1e-4;
+    for (size_t i = 0; i < soa.size(); i++) {
+        const parfis::Vec3D<parfis::cellPos_t>& cellPos = pSimData->cellVec[soa.cellId[i]].pos;
+        Vec pos = {cellPos.x + soa.posX[i], cellPos.y + soa.posY[i], cellPos.z + soa.posZ[i]};
+        Vec vel = {soa.velX[i], soa.velY[i], soa.velZ[i]};
+        for (int k = 0; k < 3; k++) {
+            double len = count[k];
+            double u = pos0[i][k] + steps*vel0[i][k];
+            double expPos, expVel = vel0[i][k];
+            if (periodic[k]) {
+                expPos = u - len*floor(u/len);
+                double diff = fabs(pos[k] - expPos);
+                ASSERT_LT(std::min(diff, len - diff), tol);
+            }
+            else {
+                expPos = u - 2*len*floor(u/(2*len));
+                if (expPos > len) {
+                    expPos = 2*len - expPos;
+                    expVel = -expVel;
+                }
+                ASSERT_NEAR(pos[k], expPos, tol);
+            }
+            ASSERT_NEAR(vel[k], expVel, tol);
+            ASSERT_GE(pos[k], 0.0);
+            ASSERT_LE(pos[k], len);
+        }
+    }
+    parfis::api::deleteParfis(id);
+}
+
 /** @} gtestAll*/
\ No newline at end of file
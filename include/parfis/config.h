@@ -38,12 +38,14 @@
 domain = [system, particle] <parfis::Domain> # Domains are defined as separate classes in the code\n\
 \n\
 #------------ System ------------\n\
-system = [geometry, timestep, geometrySize, cellSize, periodicBoundary, field] <parfis::Param> # System domain  \n\
-system.geometry = 1 <int> # Only cylindrical geometry is supported for now (0: cubical, 1: cylindrical)\n\
+system = [geometry, timestep, geometrySize, cellSize, periodicBoundary, field, threads, cellOrder] <parfis::Param> # System domain  \n\
+system.geometry = 1 <int> # Geometry type (0: box, every cell is full, 1: cylindrical)\n\
 system.timestep = 1.0 <double> # Timestep is given in seconds \n\
 system.geometrySize = [0.02, 0.02, 0.4] <double> # System geometry size in meters \n\
 system.cellSize = [1e-3, 1e-3, 1e-3] <double> # Cell size in meters \n\
 system.periodicBoundary = [0, 0, 0] <int> # Boundary condition (0: wall, 1: periodic)\n\
+system.threads = 1 <int> # Number of threads for pushing states, cells are split in z-slabs (0: all hardware threads)\n\
+system.cellOrder = 0 <int> # Order of cells in memory (0: loops over x, y and z, 1: tiles along the Morton curve, 2: tiles along the Hilbert curve)\n\
 # Field\n\
 system.field = [typeE, typeB, strengthE, strengthB] <parfis::Param> # Field parameters\n\
 system.field.typeE = [0, 0, 0] <int> # Type of electric field 0: none, 1: uniform\n\
@@ -52,7 +54,13 @@ system.field.strengthE = [0, 0, 0] <double> # Strength of electric field in V/m\
 system.field.strengthB = [0, 0, 0] <double> # Strength of magnetic field in T\n\
 \n\
 #------------ Particles ------------\n\
-particle = specie <parfis::Param> # Particle domain\n\
+particle = [specie, stateLayout, rebinPeriod, colTableBins, colTableMaxError, crossSectionCache, collisionCounterBins] <parfis::Param> # Particle domain\n\
+particle.stateLayout = 0 <int> # Memory layout of states (0: array of structures, 1: structure of arrays, 2: structure of arrays sorted in cell bins)\n\
+particle.rebinPeriod = 10 <int> # Number of steps between sorting states in cell bins (used for stateLayout = 2)\n\
+particle.colTableBins = 0 <int> # Initial number of bins of the float collision tables, uniform in velocity squared (0: tables are not used)\n\
+particle.colTableMaxError = 5e-3 <double> # Maximal error of the collision probability in the float tables (bins are doubled until it is reached)\n\
+particle.crossSectionCache = 0 <int> # Binary cache of the cross section files, written next to them with the extension .pfcache (0: no, 1: yes)\n\
+particle.collisionCounterBins = 16 <int> # Number of energy bins of the collision counters, from zero to the max energy of the specie\n\
 particle.specie = \"a\" <parfis::Param> # Species\n\
 particle.specie.a = [statesPerCell, timestepRatio, amuMass, eCharge, velInitDist, velInitDistMin, velInitDistMax, randomSeed] <parfis::Param> # Parameters for each specie \n\
 particle.specie.a.statesPerCell = 10 <int> # Number of states (particles) per cell\n\
@@ -67,7 +75,7 @@ particle.specie.a.randomSeed = 0 <int> # Seed for the random engine (0: random_d
 #------------ Command Chain ------------\n\
 commandChain = [create, evolve] <parfis::CommandChain> # Command chain\n\
 commandChain.create = [createCells, createStates] <parfis::Command> # Commands for creation of data \n\
-commandChain.evolve = [pushStates] <parfis::Command> # Commands for evolving the system\n\
+commandChain.evolve = [pushStates, collideStates] <parfis::Command> # Commands for evolving the system\n\
 "
 /** @} configuration */
 #endif // PARFIS_CONFIG_H
@@ -15,7 +15,13 @@
 #include <math.h>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <random>
+#include <cstdlib>
+#include <new>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
 
 /// Logging level defined from cmake is or-ed with bitmask to log strings.
 #if defined(PARFIS_LOG_LEVEL)
@@ -56,14 +62,71 @@ namespace parfis {
     typedef uint16_t cellPos_t;
     /// Type for node bitwise marking
     typedef uint8_t nodeFlag_t;
-    /// Type for state flags
-    typedef uint8_t stateFlag_t;
-    /// Type for random generator engine
-    typedef std::mt19937_64 randEngine_t;
 
-    struct StateFlag {
-        constexpr static stateFlag_t None = 0;
-        constexpr static stateFlag_t PushedState = 1;
+    /// Physical and mathematical constats
+    struct Const {
+        /// Pi
+        static constexpr double pi = 3.14159265358979323846;
+        /// Pi/2
+        static constexpr double halfPi = 1.57079632679489661923;
+        /// One atomic mass unit [kg]
+        static constexpr double amuKg = 1.66053906660e-27;
+        /// Electron mass [kg]
+        static constexpr double eMass = 9.1093837015e-31;
+        /// Elementary charge [C]
+        static constexpr double eCharge = 1.602176634e-19;
+        /// One joule in electronvolts [eV]
+        static constexpr double JeV = 6.2415090744608e18;
+        /// One electronvolt in joules [J]
+        static constexpr double eVJ = 1.602176634e-19;
+        /// Avogadro constant [mol^-1]
+        static constexpr double Na = 6.02214076e23;
+        /// Version string
+        static const uint32_t logLevel;
+        /// Version string
+        static const char* version;
+        /// Build configuration
+        static const char* buildConfig;
+        /// Git tag string
+        static const char* gitTag;
+        /// Multiline string starts and ends with this separator
+        static const std::string multilineSeparator;
+        /// Maximum number of cell ids
+        static constexpr cellId_t cellIdMax = UINT32_MAX;
+        /// Id that represents that no cell exists
+        static constexpr cellId_t noCellId = UINT32_MAX;
+        /// Id that represents that no state exists
+        static constexpr stateId_t noStateId = UINT32_MAX;
+    };
+
+    /// State storage layout
+    struct StateLayout {
+        /// Array of structs, states are stored in SimData::stateVec
+        constexpr static int AoS = 0;
+        /// Structure of arrays, states are stored in SimData::stateSoA
+        constexpr static int SoA = 1;
+        /// Structure of arrays sorted in cell bins given by SimData::binOffsetVec
+        constexpr static int Binned = 2;
+    };
+
+    /// Order of cells in SimData::cellVec
+    struct CellOrder {
+        /// Cells are created in loops over x, y and z (z is the inner loop)
+        constexpr static int Loop = 0;
+        /// Tiles of cells are ordered along the Morton (Z-order) curve
+        constexpr static int Morton = 1;
+        /// Tiles of cells are ordered along the Hilbert curve
+        constexpr static int Hilbert = 2;
+    };
+
+    /// Type of the field, used to select the push kernel
+    struct FieldType {
+        /// No field
+        constexpr static int None = 0;
+        /// Uniform electric field
+        constexpr static int UniformE = 1;
+        /// Uniform electric and magnetic field
+        constexpr static int UniformEB = 2;
     };
 
     struct NodeFlag {
@@ -187,7 +250,52 @@ namespace parfis {
         T lenSq() const { return x * x + y * y + z * z; }
     };
 
-        struct PyVecContainer
+    /**
+     * @brief Allocator with aligned memory, used for vectors accessed by the SIMD kernels
+     * @tparam T type of the allocated elements
+     * @tparam N alignment in bytes (cache line by default)
+     */
+    template<class T, size_t N = 64>
+    struct AlignedAllocator
+    {
+        typedef T value_type;
+        template<class U> struct rebind { typedef AlignedAllocator<U, N> other; };
+        AlignedAllocator() = default;
+        template<class U> AlignedAllocator(const AlignedAllocator<U, N>&) {}
+
+        T* allocate(size_t n) {
+            // Size must be a multiple of the alignment
+            size_t bytes = ((n * sizeof(T) + N - 1) / N) * N;
+            if (bytes == 0) bytes = N;
+#if defined(_MSC_VER)
+            void* ptr = _aligned_malloc(bytes, N);
+#else
+            void* ptr = std::aligned_alloc(N, bytes);
+#endif
+            if (ptr == nullptr)
+                throw std::bad_alloc();
+            return static_cast<T*>(ptr);
+        }
+
+        void deallocate(T* ptr, size_t) {
+#if defined(_MSC_VER)
+            _aligned_free(ptr);
+#else
+            std::free(ptr);
+#endif
+        }
+
+        template<class U>
+        bool operator==(const AlignedAllocator<U, N>&) const { return true; }
+        template<class U>
+        bool operator!=(const AlignedAllocator<U, N>&) const { return false; }
+    };
+
+    /// Vector with memory aligned to the cache line
+    template<class T>
+    using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+    struct PyVecContainer
     {
         static std::vector<const char *> pyStrVec;
     };
@@ -202,7 +310,8 @@ namespace parfis {
         const T* ptr;
         size_t size;
 
-        PyVec<T>& operator=(const std::vector<T>& tVec) {
+        template<class A>
+        PyVec<T>& operator=(const std::vector<T, A>& tVec) {
             size = tVec.size();
             if (size > 0)
                 ptr = &tVec[0];
@@ -283,6 +392,63 @@ namespace parfis {
         Vec3D<cellPos_t> pos;
     };
 
+    /**
+     * @brief Cells of one (x, y) column of the grid, or of one tile of the column
+     * @details Cells of a column (tile) have consecutive ids in SimData::cellVec, the cell 
+     * at zFirst + k has the id firstId + k.
+     */
+    struct CellColumn
+    {
+        /// Id of the first cell of the column
+        cellId_t firstId;
+        /// Z position of the first cell of the column
+        cellPos_t zFirst;
+        /// Number of cells in the column (zero for a column without cells)
+        cellPos_t zCount;
+    };
+
+    /**
+     * @brief Map from the cell position to the cell id
+     * @details Instead of a cell id for every position of the grid, only a CellColumn 
+     * is stored for every (x, y) column, so the size of the map is 
+     * cellCount.x*cellCount.y*sizeof(CellColumn) and doesn't depend on cellCount.z. 
+     * If cells are ordered in tiles (CellOrder), columns are split in tiles of 
+     * 2^shiftZ cells in z, and a CellColumn is stored for every tile.
+     */
+    struct CellIndex
+    {
+        /// Number of cells in y
+        int countY;
+        /// Tile of position z is z >> shiftZ
+        int shiftZ;
+        /// Number of tiles in a column
+        int tileCnt;
+        /// Tile of position (x, y, z) is at columnVec[(x*countY + y)*tileCnt + (z >> shiftZ)]
+        std::vector<CellColumn> columnVec;
+
+        /// Cell id of the position, Const::noCellId if there is no cell
+        cellId_t cellId(const Vec3D<cellPos_t>& pos) const {
+            const CellColumn& col = 
+                columnVec[(size_t(pos.x)*countY + pos.y)*tileCnt + (pos.z >> shiftZ)];
+            cellPos_t dz = cellPos_t(pos.z - col.zFirst);
+            return dz < col.zCount ? col.firstId + dz : Const::noCellId;
+        }
+        int build(const std::vector<Cell>& cellVec, const Vec3D<int>& cellCount, 
+            int shift = 16);
+    };
+
+    /**
+     * @brief State that crossed to a neighbouring cell
+     * @details Delta is the change of the cell position in every direction (-1, 0 or 1).
+     */
+    struct CellCrossing
+    {
+        /// Id of the state
+        stateId_t stateId;
+        /// Change of the cell position
+        Vec3D<int8_t> delta;
+    };
+
     /**
      * @brief Specie state
      * @details One state is defined as a point in the phase space. The next and prev 
@@ -300,6 +466,171 @@ namespace parfis {
         Vec3D<state_t> vel;
     };
 
+    /**
+     * @brief Specie states stored as a structure of arrays
+     * @details Used when CfgData::stateLayout is StateLayout::SoA. Every component of 
+     * the State is kept in a separate, cache line aligned, array so the push kernels 
+     * can advance several states with a single SIMD instruction. The id of a state is 
+     * its position in the arrays, same as for SimData::stateVec. For StateLayout::Binned 
+     * the cell linking arrays (next, prev) are not used, and the cell of every state is 
+     * kept in cellId instead.
+     */
+    struct StateSoA
+    {
+        /// Position x component
+        AlignedVector<state_t> posX;
+        /// Position y component
+        AlignedVector<state_t> posY;
+        /// Position z component
+        AlignedVector<state_t> posZ;
+        /// Velocity x component
+        AlignedVector<state_t> velX;
+        /// Velocity y component
+        AlignedVector<state_t> velY;
+        /// Velocity z component
+        AlignedVector<state_t> velZ;
+        /// Next state from the same cell, Const::noStateId for the last state
+        AlignedVector<stateId_t> next;
+        /// Previous state from the same cell, Const::noStateId for the head state
+        AlignedVector<stateId_t> prev;
+        /// Cell of the state (used for StateLayout::Binned)
+        AlignedVector<cellId_t> cellId;
+
+        /// Number of states
+        size_t size() const { return posX.size(); }
+        void reserve(size_t n, bool binned = false);
+        void clear();
+        void push_back(const State& state);
+        void push_back(const State& state, cellId_t cell);
+        State getState(stateId_t id) const;
+        void setState(stateId_t id, const State& state);
+    };
+
+    /**
+     * @brief States that left the cylinder, gathered for the batched wall reflection
+     * @details Positions are relative to the axis of the cylinder and are taken before 
+     * the step, velocities are in cells per timestep. After Particle::reflectCylindricalBatch 
+     * positions and velocities are the ones at the end of the timestep.
+     */
+    struct WallBatch
+    {
+        /// Id of the state
+        std::vector<stateId_t> stateId;
+        /// Cell of the state
+        std::vector<cellId_t> cellId;
+        /// Position x component, relative to the axis
+        AlignedVector<double> posX;
+        /// Position y component, relative to the axis
+        AlignedVector<double> posY;
+        /// Velocity x component
+        AlignedVector<double> velX;
+        /// Velocity y component
+        AlignedVector<double> velY;
+
+        /// Number of states
+        size_t size() const { return stateId.size(); }
+        void clear();
+        void push_back(stateId_t id, cellId_t cell, double rx, double ry, double vx, double vy);
+    };
+
+    /**
+     * @brief Collision candidates of a specie, gathered for the batched collisions
+     * @details Filled by Particle::findColliders, which keeps only the states that 
+     * collide, and used by Particle::scatterColliders. Velocities are in units of 
+     * Specie::maxVel.
+     */
+    struct CollisionBatch
+    {
+        /// Id of the state
+        std::vector<stateId_t> stateId;
+        /// Velocity x component
+        AlignedVector<double> velX;
+        /// Velocity y component
+        AlignedVector<double> velY;
+        /// Velocity z component
+        AlignedVector<double> velZ;
+        /// Velocity squared
+        AlignedVector<double> velSq;
+        /// Random number from [0, Specie::maxColProb), selects the collision
+        AlignedVector<double> rand;
+        /// Total collision probability
+        AlignedVector<double> prob;
+        /// Position in Specie::scatterCosVec for the deflection, set in the scattering
+        AlignedVector<double> cosIndex;
+        /// GasCollision::lossSq of the collision, set in the scattering
+        AlignedVector<double> lossSq;
+        /// GasCollision::massRatio of the collision, set in the scattering
+        AlignedVector<double> massRatio;
+        /// Random number from [0, 1) for the azimuth of the deflection, set in the scattering
+        AlignedVector<double> azimuth;
+        /// GasCollision::id of the collision, set in the scattering
+        std::vector<uint32_t> gasCollisionId;
+
+        /// Number of states
+        size_t size() const { return stateId.size(); }
+        void clear();
+        void resize(size_t n);
+        void push_back(stateId_t id, double vx, double vy, double vz, double r);
+        void copy(size_t dst, size_t src);
+    };
+
+    /**
+     * @brief Counters of the collision events, binned in the energy of the state
+     * @details Every thread counts the events of its states in its own counter, and the 
+     * counters of the threads are added to SimData::collisionCounter at the end of the 
+     * collision step. Bins are uniform in the energy from zero to Specie::maxEv, states 
+     * above Specie::maxEv are in the last bin.
+     */
+    struct CollisionCounter
+    {
+        /// Number of energy bins
+        int binCnt;
+        /// Null collisions of a specie, Specie::id*binCnt + bin
+        std::vector<uint64_t> nullCollisionCntVec;
+        /// Real collisions, GasCollision::id*binCnt + bin
+        std::vector<uint64_t> collisionCntVec;
+        /// Energy lost in the collisions in eV, GasCollision::id*binCnt + bin
+        std::vector<double> energyLossVec;
+
+        /// Bin of the velocity squared, in units of Specie::maxVel
+        int bin(double velSq) const {
+            int b = int(velSq*binCnt);
+            return b < binCnt ? b : binCnt - 1;
+        }
+        void reset(int bins, size_t specieCnt, size_t gasCollisionCnt);
+        void clear();
+        void add(const CollisionCounter& counter);
+    };
+
+    /**
+     * @brief Wrapper for the StateSoA structure to be used by ctypes in python.
+     */
+    struct PyStateSoA
+    {
+        PyVec<state_t> posX;
+        PyVec<state_t> posY;
+        PyVec<state_t> posZ;
+        PyVec<state_t> velX;
+        PyVec<state_t> velY;
+        PyVec<state_t> velZ;
+        PyVec<stateId_t> next;
+        PyVec<stateId_t> prev;
+        PyVec<cellId_t> cellId;
+        /// Overload of the equal operator for easier manipulation
+        PyStateSoA& operator=(const StateSoA& soa) {
+            posX = soa.posX;
+            posY = soa.posY;
+            posZ = soa.posZ;
+            velX = soa.velX;
+            velY = soa.velY;
+            velZ = soa.velZ;
+            next = soa.next;
+            prev = soa.prev;
+            cellId = soa.cellId;
+            return *this;
+        }
+    };
+
     /**
      * @brief Holds information about each specie
      */
@@ -349,6 +680,21 @@ namespace parfis {
         std::vector<uint32_t> gasCollisionVecId;
         /// Id for the total collision probability matrix, from gasCollisionProbVec
         uint32_t gasCollisionProbId;
+        /// Id of the first state of the specie (states of a specie are stored contiguously)
+        stateId_t stateIdOffset;
+        /// Boris rotation vector q*B*dt/(2*m) for uniform field B
+        Vec3D<double> borisT;
+        /// Boris coefficient 2/(1 + borisT^2)
+        double borisS;
+        /// Cell size relative to cellSize.x, used for the rotation of velocity
+        Vec3D<double> cellScale;
+        /// Maximal total collision probability in one timestep, for velocities up to maxVel
+        double maxColProb;
+        /// Key of the random streams of the specie (randomSeed, or from random_device)
+        uint64_t randomKey;
+        /// Cosines of GasCollision::scatterAngle of all collisions of the specie, one 
+        /// table after another (from GasCollision::scatterCosId)
+        std::vector<double> scatterCosVec;
     };
 
     /**
@@ -393,9 +739,80 @@ namespace parfis {
         std::vector<double> xVec;
         /// Y values
         std::vector<double> yVec;
-        /// Function to run the evaluation based on type
-        std::function<double(double)> eval;
-        int loadData(const std::string& fileName);
+        /// First x value of every range
+        std::vector<double> rangeStart;
+        /// Index in xVec of the first x value of every range
+        std::vector<int> rangeOffset;
+        /// Number of y values for every x value (y values of one x are contiguous)
+        int yStride;
+        /// Version of the binary cache file format
+        static constexpr uint32_t cacheVersion = 1;
+        /// Extension appended to the name of the data file for the cache file
+        static constexpr const char* cacheExtension = ".pfcache";
+
+        /**
+         * @brief Header of the binary cache file
+         * @details Followed by ranges, xVec, yVec (doubles) and nbins (int32), the 
+         * checksum is the hash of these data.
+         */
+        struct CacheHeader
+        {
+            /// File identifier "PFXSEC" with two zeros
+            char magic[8];
+            /// FuncTable::cacheVersion
+            uint32_t version;
+            /// Number of data rows (colCnt after loading from the data file)
+            int32_t pointCnt;
+            /// Hash of the data file
+            uint64_t sourceHash;
+            /// Number of values in ranges
+            uint64_t rangeCnt;
+            /// Number of values in nbins
+            uint64_t nbinsCnt;
+            /// Number of values in xVec
+            uint64_t xCnt;
+            /// Number of values in yVec
+            uint64_t yCnt;
+            /// Hash of the data after the header
+            uint64_t checksum;
+        };
+        int loadData(const std::string& fileName, bool cache = false);
+        int loadData(const std::string& fileName, const std::string& content, 
+            uint64_t sourceHash, bool cache);
+        int readCache(const std::string& cacheName, uint64_t sourceHash);
+        int writeCache(const std::string& cacheName, uint64_t sourceHash) const;
+        int setIndex();
+        void evalBatch(const double* x, size_t n, double* y, int col = 0) const;
+
+        /**
+         * @brief Finds the tabulated point for the value x in constant time
+         * @details The range is found by counting the range starts that are not larger 
+         * than x, without branches (tables have only a few ranges), and the point in 
+         * the range is found from idx. Requires FuncTable::setIndex.
+         * @param x value on the x-axis
+         * @return Index of the last value in xVec that is not larger than x, values out 
+         * of the table give the first or the last index
+         */
+        size_t xIndex(double x) const 
+        {
+            size_t r = 0;
+            for (size_t i = 1; i < rangeStart.size(); i++)
+                r += x >= rangeStart[i];
+            double pos = (x - rangeStart[r])*idx[r] + rangeOffset[r];
+            double posMax = double(xVec.size() - 1);
+            return size_t(pos < 0.0 ? 0.0 : (pos > posMax ? posMax : pos));
+        }
+
+        /**
+         * @brief Tabulated value for x, from the last tabulated point not larger than x
+         * @param x value on the x-axis
+         * @param col column of the y values (for tables with several y values per x)
+         * @return The y value
+         */
+        double eval(double x, int col = 0) const 
+        {
+            return yVec[xIndex(x)*yStride + col];
+        }
     };
 
     /**
@@ -435,6 +852,25 @@ namespace parfis {
         }
     };
 
+    /**
+     * @brief Read-only tables loaded from files, shared by all Parfis objects
+     * @details Tables are kept by the file name, the type and the hash of the file 
+     * content, so a changed file is loaded again. The registry holds weak pointers, so 
+     * a table is freed when the last object that uses it is deleted.
+     */
+    struct FuncTableRegistry
+    {
+        static int load(const std::string& fileName, int type, bool cache, 
+            std::shared_ptr<const FuncTable>& ftab);
+        static size_t size();
+
+    private:
+        /// Guards the table map, Parfis objects can be created from several threads
+        static std::mutex m_mutex;
+        /// Tables by the key (file name, type and hash of the file content)
+        static std::map<std::string, std::weak_ptr<const FuncTable>> m_tableMap;
+    };
+
     /**
      * @brief Holds information about collisions with gas particles
      */
@@ -454,12 +890,21 @@ namespace parfis {
         double threshold;
         /// Type of collision (elastic, inelastic)
         int type;
-        /// Scattering angle (random number sampled with scatterAngle gives deflection in radians)
+        /// Scattering angle (deflection in radians in the center of mass frame, at equally 
+        /// spaced values of the cumulative probability from 0 to 1)
         std::vector<double> scatterAngle;
-        /// Cross section in angstroms, with x-axis is in eV
-        FuncTable xSecFtab;
+        /// Cross section in angstroms, with x-axis is in eV (read-only, shared by the 
+        /// Parfis objects through FuncTableRegistry)
+        std::shared_ptr<const FuncTable> xSecFtab;
         /// Collision frequency, x-axis is in code velocity squared
         FuncTable freqFtab;
+        /// Index of the first cosine of scatterAngle in Specie::scatterCosVec
+        uint32_t scatterCosId;
+        /// Gas particle mass over the sum of masses (gas particle is at rest)
+        double massRatio;
+        /// Decrease of the relative velocity squared (threshold over the reduced mass), 
+        /// in units of Specie::maxVel squared
+        double lossSq;
         int calculateColFreq(const Specie & specie, const Gas& gas);
     };
 
@@ -483,7 +928,8 @@ namespace parfis {
         double threshold;
         /// Type of collision (elastic, inelastic)
         int type;
-        /// Scattering angle (random number sampled with scatterAngle gives deflection in radians)
+        /// Scattering angle (deflection in radians in the center of mass frame, at equally 
+        /// spaced values of the cumulative probability from 0 to 1)
         PyVec<double> scatterAngle;
         /// Cross section in angstroms, with x-axis is in eV
         PyFuncTable xSecFtab;
@@ -499,12 +945,92 @@ namespace parfis {
             threshold = gasCol.threshold;
             type = gasCol.type;
             scatterAngle = gasCol.scatterAngle;
-            xSecFtab = gasCol.xSecFtab;
+            xSecFtab = *gasCol.xSecFtab;
             freqFtab = gasCol.freqFtab;
             return *this;
         }
     };
 
+    /**
+     * @brief Collision probabilities of a specie in float, in uniform bins of velocity 
+     * squared
+     * @details Resampled from the table in SimData::gasCollisionProbVec, for velocities 
+     * up to Specie::maxVel (x from 0 to 1). Cumulative probabilities of all collisions 
+     * of a bin are stored next to each other, and stride divides the cache line, 
+     * so the values of one bin are in a single cache line. The error is large in the bins 
+     * with a jump of the probability (threshold of the inelastic collision), since 
+     * the bins are uniform.
+     */
+    struct ColProbTable
+    {
+        /// Largest number of bins for SimData::resampleColProb
+        static constexpr int maxBinCnt = 1 << 16;
+        /// Number of bins
+        int binCnt;
+        /// Number of collisions (columns of the FuncTable)
+        int colCnt;
+        /// Number of floats for every bin (colCnt rounded up to a power of two or to 16*n)
+        int stride;
+        /// Maximal absolute difference from the FuncTable, for x from 0 to 1
+        double maxError;
+        /// Cumulative collision probabilities, the last collision has the total probability
+        AlignedVector<float> prob;
+        double resample(const FuncTable& ftab, int bins);
+        void evalBatch(const double* x, size_t n, double* y, int col) const;
+
+        /// Index of the bin with the velocity squared x
+        int index(double x) const 
+        {
+            int b = int(x*binCnt);
+            return b < binCnt ? b : binCnt - 1;
+        }
+
+        /// Cumulative probabilities of the bin with the velocity squared x
+        const float* bin(double x) const 
+        {
+            return &prob[stride*index(x)];
+        }
+    };
+
+    /**
+     * @brief Alias tables (Walker's method) for selecting the collision of a specie
+     * @details There is one table for every row of the collision probability table (a row 
+     * of the FuncTable from SimData::gasCollisionProbVec, or a bin of the ColProbTable). 
+     * A random number u from [0, 1) gives the column i = floor(u*colCnt), and the 
+     * collision is i if the fraction of u*colCnt is below the probability of the column, 
+     * otherwise it is the alias of the column. Selection reads one entry for any number 
+     * of collisions.
+     */
+    struct ColAliasTable
+    {
+        /// Column of the alias table
+        struct Entry
+        {
+            /// Probability of keeping the column
+            double prob;
+            /// Collision selected if the column is not kept
+            uint32_t alias;
+        };
+        /// Number of rows
+        int rowCnt;
+        /// Number of collisions
+        int colCnt;
+        /// Entries of all rows, row after row
+        std::vector<Entry> entry;
+        void build(const FuncTable& ftab);
+        void build(const ColProbTable& tab);
+        void buildRow(int row, const double* cumProb);
+
+        /// Collision from the row, for the random number u from [0, 1)
+        int sample(int row, double u) const 
+        {
+            double x = u*colCnt;
+            int i = int(x) < colCnt ? int(x) : colCnt - 1;
+            const Entry& e = entry[size_t(row)*colCnt + i];
+            return x - i < e.prob ? i : int(e.alias);
+        }
+    };
+
 
     /**
      * @brief Holds data about the electromagnetic field.
@@ -537,13 +1063,21 @@ namespace parfis {
         PyVec<std::string> gasNameVec;
         PyVec<std::string> gasCollisionNameVec;
         PyVec<std::string> gasCollisionFileNameVec;
+        int stateLayout;
+        int rebinPeriod;
+        int threads;
+        int cellOrder;
+        int colTableBins;
+        double colTableMaxError;
+        int crossSectionCache;
+        int collisionCounterBins;
     };
 
     /**
      * @brief Configuration parameters data
      */
     struct CfgData {
-        /// Geometry type
+        /// Geometry type (0: box, 1: cylindrical)
         int geometry;
         /// Timestep for the system in seconds
         double timestep;
@@ -563,6 +1097,22 @@ namespace parfis {
         std::vector<std::string> gasCollisionNameVec;
         /// GasCollision file names
         std::vector<std::string> gasCollisionFileNameVec;
+        /// State storage layout (StateLayout::AoS, StateLayout::SoA or StateLayout::Binned)
+        int stateLayout;
+        /// Number of evolve steps between sorting states in cell bins (StateLayout::Binned)
+        int rebinPeriod;
+        /// Number of threads for pushing states (every thread pushes one z-slab of cells)
+        int threads;
+        /// Order of cells in SimData::cellVec (CellOrder)
+        int cellOrder;
+        /// Initial number of bins of the float collision tables (0: tables are not used)
+        int colTableBins;
+        /// Maximal error of the float collision tables, bins are doubled until it is reached
+        double colTableMaxError;
+        /// Use binary cache files for the cross sections (0: no, 1: yes)
+        int crossSectionCache;
+        /// Number of energy bins of the collision counters (SimData::collisionCounter)
+        int collisionCounterBins;
         /// PyCfgData points to data of this object
         PyCfgData pyCfgData;
         /// Get absolute cell id from i,j,k
@@ -580,7 +1130,8 @@ namespace parfis {
     struct PySimData
     {
         PyVec<State> stateVec;
-        PyVec<cellId_t> cellIdVec;
+        PyVec<CellColumn> cellColumnVec;
+        int cellIndexShiftZ;
         PyVec<cellId_t> cellIdAVec;
         PyVec<cellId_t> cellIdBVec;
         PyVec<Specie> specieVec;
@@ -590,6 +1141,11 @@ namespace parfis {
         PyVec<Gas> gasVec;
         PyVec<PyGasCollision> pyGasCollisionVec;
         PyVec<PyFuncTable> pyGasCollisionProbVec;
+        PyStateSoA stateSoA;
+        PyVec<stateId_t> binOffsetVec;
+        PyVec<uint64_t> nullCollisionCntVec;
+        PyVec<uint64_t> collisionCntVec;
+        PyVec<double> collisionEnergyLossVec;
     };
 
     /**
@@ -598,14 +1154,10 @@ namespace parfis {
     struct SimData {
         /// Vector of cells
         std::vector<Cell> cellVec;
-        /**
-         * @brief Vector of pointers to the cellVec.
-         * @details Maping of absolute cell id (calculated) to real cell id which is the position 
-         * in the cellVec vector
-         */
         /// Vector of nodeFlags for each cell in the geometry - corresponds to cellVec
         std::vector<nodeFlag_t> nodeFlagVec;
-        std::vector<cellId_t> cellIdVec;
+        /// Map of the cell position to the id of the cell in cellVec
+        CellIndex cellIndex;
         /**
          * @brief Vector of pointer to cells of group A
          * @details Groups are used to classify cells, for examples cells that lie fully inside
@@ -617,8 +1169,8 @@ namespace parfis {
         std::vector<cellId_t> cellIdBVec;
         /// Vector of states
         std::vector<State> stateVec;
-        /// Vector of state flags - corresponds to stateVec
-        std::vector<stateFlag_t> stateFlagVec;
+        /// States as a structure of arrays (used instead of stateVec for StateLayout::SoA)
+        StateSoA stateSoA;
         /**
          * @brief Vector of pointers to head states
          * @details Head state is the first state in the doubly linked list of states that 
@@ -627,12 +1179,17 @@ namespace parfis {
          * the number of elements is cellVec.size()*specieVec.size()
          */
         std::vector<stateId_t> headIdVec;
+        /**
+         * @brief Offsets of cell bins for StateLayout::Binned
+         * @details States of a specie that were in a cell at the last sorting are stored 
+         * between binOffsetVec[headIdOffset + cellId] and binOffsetVec[headIdOffset + cellId + 1] 
+         * (compressed sparse row format). The size is specieVec.size()*cellVec.size() + 1.
+         */
+        std::vector<stateId_t> binOffsetVec;
         /// Vector of species
         std::vector<Specie> specieVec;
         /// Vector of gases
         std::vector<Gas> gasVec;
-        /// Engines used to generate random numbers
-        std::vector<randEngine_t> randomEngineVec;
         /// Vector of gas collision data
         std::vector<GasCollision> gasCollisionVec;
         /// Vector for the ctypes wrapper
@@ -641,6 +1198,12 @@ namespace parfis {
         std::vector<FuncTable> gasCollisionProbVec;
         /// Vector for the ctypes wrapper
         std::vector<PyFuncTable> pyGasCollisionProbVec;
+        /// Float collision tables for every table in gasCollisionProbVec (can be empty)
+        std::vector<ColProbTable> colProbTableVec;
+        /// Alias tables of the collisions, for the table in use (float or FuncTable)
+        std::vector<ColAliasTable> colAliasTableVec;
+        /// Collision events since the last reset, summed over the threads
+        CollisionCounter collisionCounter;
         /// Field data
         Field field;
         /// PySimData points to data of this object
@@ -649,6 +1212,9 @@ namespace parfis {
         uint64_t evolveCnt;
         int setPySimData();
         int calculateColProb(const CfgData * pCfgData);
+        int resampleColProb(const CfgData * pCfgData);
+        int calculateScatterTable();
+        int calculateColAlias();
     };
     /** @} data */
 
@@ -784,4 +1350,4 @@ namespace parfis {
     /** @} configuration */
 }
 
-#endif // PARFIS_DATASTRUCT_H
\ No newline at end of file
+#endif // PARFIS_DATASTRUCT_H
\ No newline at end of file
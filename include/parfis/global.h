@@ -36,6 +36,11 @@ namespace parfis
 
         /// Check if file @param fname exists
         static bool fileExists (const std::string& fname);
+        static int readFile(const std::string& fname, std::string& content);
+        static uint64_t hash(const void* data, size_t size, 
+            uint64_t seed = 14695981039346656037ull);
+        static uint64_t mortonKey(uint32_t x, uint32_t y, uint32_t z);
+        static uint64_t hilbertKey(uint32_t x, uint32_t y, uint32_t z, int bits);
 
         static std::vector<std::string> getVector(const std::string& str, char bra, char ket);
         static std::vector<std::string> getInheritanceVector(const std::string& str);
@@ -54,42 +59,6 @@ namespace parfis
         static std::string to_string(int num);
     };
 
-    /// Physical and mathematical constats
-    struct Const {
-        /// Pi
-        static constexpr double pi = 3.14159265358979323846;
-        /// Pi/2
-        static constexpr double halfPi = 1.57079632679489661923;
-        /// One atomic mass unit [kg]
-        static constexpr double amuKg = 1.66053906660e-27;
-        /// Electron mass [kg]
-        static constexpr double eMass = 9.1093837015e-31;
-        /// Elementary charge [C]
-        static constexpr double eCharge = 1.602176634e-19;
-        /// One joule in electronvolts [eV]
-        static constexpr double JeV = 6.2415090744608e18;
-        /// One electronvolt in joules [J]
-        static constexpr double eVJ = 1.602176634e-19;
-        /// Avogadro constant [mol^-1]
-        static constexpr double Na = 6.02214076e23;
-        /// Version string
-        static const uint32_t logLevel;
-        /// Version string
-        static const char* version;
-        /// Build configuration
-        static const char* buildConfig;
-        /// Git tag string
-        static const char* gitTag;
-        /// Multiline string starts and ends with this separator
-        static const std::string multilineSeparator;
-        /// Maximum number of cell ids for cellIdVec containter
-        static constexpr cellId_t cellIdMax = UINT32_MAX;
-        /// Id that represents that no cell exists
-        static constexpr cellId_t noCellId = UINT32_MAX;
-        /// Id that represents that no state exists
-        static constexpr stateId_t noStateId = UINT32_MAX;
-    };
-
     /// Default values of parameters
     struct ParamDefault 
     {
@@ -101,6 +70,22 @@ namespace parfis
         static constexpr Vec3D<double> velInitDistMax = {0.1, 0.1, 0.1};
         /// Defaul random seed 0: random device
         static constexpr int randomSeed = 0;
+        /// Default layout of states 0: array of structures (StateLayout::AoS)
+        static constexpr int stateLayout = 0;
+        /// Default number of evolve steps between sorting states in cell bins
+        static constexpr int rebinPeriod = 10;
+        /// Default number of threads for pushing states
+        static constexpr int threads = 1;
+        /// Default order of cells 0: loops over x, y and z (CellOrder::Loop)
+        static constexpr int cellOrder = 0;
+        /// Default number of bins of the float collision tables (0: tables are not used)
+        static constexpr int colTableBins = 0;
+        /// Default maximal error of the float collision tables
+        static constexpr double colTableMaxError = 5e-3;
+        /// Default use of the binary cache files for the cross sections 1: yes
+        static constexpr int crossSectionCache = 0;
+        /// Default number of energy bins of the collision counters
+        static constexpr int collisionCounterBins = 16;
     };
 }
 
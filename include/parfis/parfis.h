@@ -65,6 +65,8 @@ namespace parfis {
         int loadSimData();
         int loadCfgData();
         int runCommandChain(const std::string& str);
+        int evolveSteps(uint64_t stepCount, uint64_t callbackPeriod, 
+            int (*callback)(uint32_t, uint64_t));
         int configure(const char* str);
 
         Domain* getDomain(const std::string& cstr);
@@ -115,6 +117,13 @@ namespace parfis {
          * library functionality from outside.
          * @{
          */
+        /**
+         * @brief Diagnostic callback for api::evolveSteps
+         * @details Called with the Parfis id and SimData::evolveCnt. Evolving stops 
+         * if the callback returns a nonzero value.
+         */
+        typedef int (*EvolveCallback)(uint32_t id, uint64_t evolveCnt);
+
         extern "C" 
         {
             PARFIS_EXPORT const char* info();
@@ -140,6 +149,9 @@ namespace parfis {
             PARFIS_EXPORT int deleteAll();
             PARFIS_EXPORT const std::vector<uint32_t>& getParfisIdVec();
             PARFIS_EXPORT int runCommandChain(uint32_t id, const char* key);
+            PARFIS_EXPORT int evolveSteps(uint32_t id, uint64_t stepCount, 
+                uint64_t callbackPeriod = 0, EvolveCallback callback = nullptr);
+            PARFIS_EXPORT int resetCollisionCounter(uint32_t id);
             PARFIS_EXPORT const char* toStringDouble(double num);
             PARFIS_EXPORT const char* toStringFloat(float num);
         }
@@ -6,9 +6,9 @@
 #include <tuple>
 #include <string>
 #include <map>
-#include <random>
 #include "parfis.h"
 #include "datastruct.h"
+#include "threadpool.h"
 
 namespace parfis
 {
@@ -26,15 +26,89 @@ namespace parfis
         int loadSimData() override;
         int createStates();
         int createStatesOfSpecie(Specie& spec);
+        int createSlabs();
+        int getFieldType();
+        template<int fieldType, bool periodicZ>
         int pushStatesCylindrical();
+        template<int fieldType, bool periodicZ, bool boundCell>
+        void pushCellStates(Specie* pSpec, cellId_t cellId, Vec3D<double>& geoCenter, 
+            WallBatch& batch, int slabId);
+        template<bool periodicZ, bool boundCell>
+        void crossCell(Specie* pSpec, stateId_t stateId, cellId_t cellId, int slabId);
+        template<int fieldType>
+        void stepState(const Specie *pSpec, State& state);
+        template<bool periodicZ>
+        void boundZ(State& state, Cell& newCell);
+        int pushStatesCylindricalSoA();
+        int pushStatesCylindricalBinned();
+        void pushStateBinnedBound(stateId_t stateId);
+        int pushStatesBox();
+        void boundStatesBox(stateId_t first, stateId_t last);
+        static void boundStatesBox(size_t n, 
+            state_t* __restrict posX, state_t* __restrict posY, state_t* __restrict posZ, 
+            state_t* __restrict velX, state_t* __restrict velY, state_t* __restrict velZ, 
+            cellId_t* __restrict cellId, Vec3D<int> count, Vec3D<int> periodic);
+        int sortStatesBinned();
+        int collideStates();
+        void findColliders(const Specie& spec, const Vec3D<double>& velScale, 
+            stateId_t chunk, CollisionBatch& batch, CollisionCounter& counter);
+        void scatterColliders(const Specie& spec, const Vec3D<double>& velScale, 
+            CollisionBatch& batch, CollisionCounter& counter);
+        void stepStatesSoA(Specie *pSpec, stateId_t first, stateId_t last);
+        void calculateDvUniformE(Specie *pSpec);
+        void calculateBorisCoef(Specie *pSpec);
         void traverseCell(State& state, Cell& cell);
-        int reflectCylindrical(State& state, Cell& cell, Vec3D<double>& geoCenter, 
-            double invRadius);
-        void setNewCell(State& state, size_t headIdPos, size_t newHeadIdPos);
+        void traverseCellsSoA(stateId_t first, stateId_t last, cellId_t cellId,
+            std::vector<CellCrossing>& crossingVec, std::vector<stateId_t>& staleVec);
+        int reflectCylindricalBatch(WallBatch& batch, double radius);
+        void scatterWallBatch(const WallBatch& batch, Vec3D<double>& geoCenter);
+        void unlinkState(State& state, size_t headIdPos);
+        void linkState(stateId_t stateId, size_t headIdPos);
+        void unlinkStateSoA(stateId_t stateId, size_t headIdPos);
+        void linkStateSoA(stateId_t stateId, size_t headIdPos);
 
-        std::function<void(Specie*, State*)> stepState;
-        void stepStateNoField(Specie *pSpec, State *pState);
-        void stepStateUniformEz(Specie *pSpec, State *pState);
+        /// Maximal number of wall reflections of a state in one timestep
+        static constexpr int maxWallReflections = 8;
+        /// Number of states with one random stream for finding the collision candidates
+        static constexpr stateId_t collisionChunk = 4096;
+        /// Threads that push states, one thread per z-slab
+        std::shared_ptr<ThreadPool> m_pThreadPool;
+        /// Cells of group A for every z-slab
+        std::vector<std::vector<cellId_t>> m_slabCellIdAVec;
+        /// Cells of group B for every z-slab
+        std::vector<std::vector<cellId_t>> m_slabCellIdBVec;
+        /// Z-slab of every cell z index
+        std::vector<int> m_slabIdVec;
+        /**
+         * @brief Buffers of states that move to another z-slab
+         * @details Buffer [src*slabCount + dst] is filled only by the thread of the slab src 
+         * and read only by the thread of the slab dst, after all threads finished the push.
+         * Pairs are the state id and the position in headIdVec of the new cell.
+         */
+        std::vector<std::vector<std::pair<stateId_t, size_t>>> m_migrationVec;
+        /**
+         * @brief Push of a specie in which every cell was last pushed (StateLayout::AoS)
+         * @details States that move to an already pushed cell of the same z-slab are 
+         * linked to it at once, without m_migrationVec.
+         */
+        std::vector<uint32_t> m_cellPushVec;
+        /// Counter of the pushes of species, for m_cellPushVec
+        uint32_t m_pushCnt;
+        /// States that crossed to another cell, for every z-slab (StateLayout::Binned)
+        std::vector<std::vector<CellCrossing>> m_crossingVec;
+        /**
+         * @brief States pushed with the boundary checks, for every z-slab 
+         * (StateLayout::Binned)
+         * @details These are states of bound cells and states found in the bin of another 
+         * cell.
+         */
+        std::vector<std::vector<stateId_t>> m_boundStateVec;
+        /// States that left the cylinder, for every z-slab
+        std::vector<WallBatch> m_wallBatchVec;
+        /// States that collide with the gas, for every thread
+        std::vector<CollisionBatch> m_collisionBatchVec;
+        /// Collision events of the current step, for every thread
+        std::vector<CollisionCounter> m_collisionCounterVec;
     };
 }
 
@@ -0,0 +1,130 @@
+#ifndef PARFIS_RANDOM_H
+#define PARFIS_RANDOM_H
+
+/**
+ * @file random.h
+ * @brief Counter-based random number generator
+ * @details Random numbers are a function of a key and a counter (Philox4x32-10),
+ * so every (seed, specie, id, step) has its own stream of random numbers that does
+ * not depend on other streams. Results are the same for any number of threads and
+ * any order of the work.
+ */
+
+#include <cstddef>
+#include <cstdint>
+
+namespace parfis {
+
+    /// Purpose of a random stream, so the streams of the same id and step differ
+    struct RandomStreamId {
+        /// Positions and velocities of states created in a cell
+        constexpr static uint32_t CreateStates = 0;
+        /// Collision candidates of a chunk of states
+        constexpr static uint32_t FindColliders = 1;
+        /// Scattering of a state that collides
+        constexpr static uint32_t ScatterColliders = 2;
+    };
+
+    /**
+     * @brief Philox4x32-10 generator
+     * @details Four 32-bit words of the counter are mixed with two 32-bit words of the
+     * key in ten rounds of multiplications (Salmon et al., Parallel random numbers:
+     * as easy as 1, 2, 3, SC11).
+     */
+    struct Philox
+    {
+        static constexpr uint32_t M0 = 0xD2511F53;
+        static constexpr uint32_t M1 = 0xCD9E8D57;
+        static constexpr uint32_t W0 = 0x9E3779B9;
+        static constexpr uint32_t W1 = 0xBB67AE85;
+
+        /// Generates four random words from the counter ctr and the key
+        static void generate(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4])
+        {
+            uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+            uint32_t k0 = key[0], k1 = key[1];
+            for (int i = 0; i < 10; i++) {
+                uint64_t p0 = uint64_t(M0)*c0;
+                uint64_t p1 = uint64_t(M1)*c2;
+                c0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+                c2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+                c1 = uint32_t(p1);
+                c3 = uint32_t(p0);
+                k0 += W0;
+                k1 += W1;
+            }
+            out[0] = c0;
+            out[1] = c1;
+            out[2] = c2;
+            out[3] = c3;
+        }
+
+        /// Double from [0, 1) with 53 random bits from two words
+        static double toUniform(uint32_t a, uint32_t b)
+        {
+            return double((uint64_t(a) << 21) ^ (b >> 11))*(1.0/9007199254740992.0);
+        }
+    };
+
+    /**
+     * @brief Stream of uniform random numbers keyed by (seed, specie, id, step)
+     * @details The key is the seed of the specie (Specie::randomKey), and the counter
+     * holds the index of the block in the stream, the id (cell, state or chunk of
+     * states), the step and the specie with the purpose of the stream (RandomStreamId).
+     * Every block gives two numbers.
+     */
+    struct RandomStream
+    {
+        RandomStream(uint64_t seed, uint32_t specie, uint32_t id, uint64_t step,
+            uint32_t streamId) :
+            m_key{uint32_t(seed), uint32_t(seed >> 32)},
+            m_ctr{0, id, uint32_t(step), 
+                (uint32_t(step >> 32) << 16) ^ (specie << 8) ^ streamId},
+            m_pos(2) {}
+
+        /// Next random number from [0, 1)
+        double uniform()
+        {
+            if (m_pos == 2) {
+                Philox::generate(m_ctr, m_key, m_word);
+                m_ctr[0]++;
+                m_pos = 0;
+            }
+            m_pos++;
+            return m_pos == 1 ? Philox::toUniform(m_word[0], m_word[1]) : 
+                Philox::toUniform(m_word[2], m_word[3]);
+        }
+
+        /**
+         * @brief Fills an array with the next n random numbers from [0, 1)
+         * @details Blocks are independent, so iterations of the loop over the blocks 
+         * have no dependency. Gives the same numbers as n calls of uniform().
+         */
+        void uniform(double* out, size_t n)
+        {
+            size_t i = 0;
+            for (; i < n && m_pos < 2; i++)
+                out[i] = uniform();
+            uint32_t ctr[4] = {m_ctr[0], m_ctr[1], m_ctr[2], m_ctr[3]};
+            uint32_t word[4];
+            for (; i + 2 <= n; i += 2) {
+                Philox::generate(ctr, m_key, word);
+                ctr[0]++;
+                out[i] = Philox::toUniform(word[0], word[1]);
+                out[i + 1] = Philox::toUniform(word[2], word[3]);
+            }
+            m_ctr[0] = ctr[0];
+            for (; i < n; i++)
+                out[i] = uniform();
+        }
+
+    private:
+        uint32_t m_key[2];
+        uint32_t m_ctr[4];
+        uint32_t m_word[4];
+        /// Number of used numbers of the current block
+        int m_pos;
+    };
+}
+
+#endif // PARFIS_RANDOM_H
@@ -0,0 +1,345 @@
+#ifndef PARFIS_SIMD_H
+#define PARFIS_SIMD_H
+
+/**
+ * @file simd.h
+ * @brief Thin wrappers around the SIMD intrinsics used by the vectorized kernels.
+ * @details The instruction set is selected at compile time from the compiler
+ * definitions (__AVX512F__, __AVX2__), which are set by compiling with
+ * PARFIS_MARCH_NATIVE=ON or the equivalent compiler flags. When no vector
+ * instruction set is available, Pack<T> has a width of one and the kernels
+ * reduce to their scalar versions.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/// Instruction set used for parfis::simd::Pack
+#if defined(__AVX512F__)
+#define PARFIS_SIMD_NAME "avx512"
+#elif defined(__AVX2__)
+#define PARFIS_SIMD_NAME "avx2"
+#else
+#define PARFIS_SIMD_NAME "scalar"
+#endif
+
+namespace parfis {
+
+    /// Vectorized kernels building blocks
+    namespace simd {
+
+        /**
+         * @brief Pack of T values processed with a single instruction
+         * @details Generic (scalar) version, specialized for the available instruction sets.
+         */
+        template<class T>
+        struct Pack
+        {
+            static constexpr size_t width = 1;
+            /// Result of a lane-wise comparison
+            typedef bool Mask;
+            T v;
+            static Pack load(const T* p) { return {*p}; }
+            static Pack set1(T a) { return {a}; }
+            void store(T* p) const { *p = v; }
+        };
+
+        template<class T> inline Pack<T> operator+(Pack<T> a, Pack<T> b) { return {a.v + b.v}; }
+        template<class T> inline Pack<T> operator-(Pack<T> a, Pack<T> b) { return {a.v - b.v}; }
+        template<class T> inline Pack<T> operator*(Pack<T> a, Pack<T> b) { return {a.v * b.v}; }
+        /// Returns a*b + c
+        template<class T> inline Pack<T> fmadd(Pack<T> a, Pack<T> b, Pack<T> c) {
+            return {a.v * b.v + c.v};
+        }
+        template<class T> inline Pack<T> operator/(Pack<T> a, Pack<T> b) { return {a.v / b.v}; }
+        template<class T> inline Pack<T> sqrt(Pack<T> a) { return {std::sqrt(a.v)}; }
+        template<class T> inline Pack<T> floor(Pack<T> a) { return {std::floor(a.v)}; }
+        template<class T> inline Pack<T> min(Pack<T> a, Pack<T> b) { return {std::min(a.v, b.v)}; }
+        template<class T> inline Pack<T> max(Pack<T> a, Pack<T> b) { return {std::max(a.v, b.v)}; }
+        template<class T> inline bool cmpLt(Pack<T> a, Pack<T> b) { return a.v < b.v; }
+        template<class T> inline bool cmpGt(Pack<T> a, Pack<T> b) { return a.v > b.v; }
+        /// Returns a in lanes where the mask is set and zero in other lanes
+        template<class T> inline Pack<T> select(bool m, Pack<T> a) { return {m ? a.v : T(0)}; }
+        /// Returns b in lanes where the mask is set and a in other lanes
+        template<class T> inline Pack<T> blend(bool m, Pack<T> a, Pack<T> b) { 
+            return {m ? b.v : a.v}; 
+        }
+        /// Returns the mask as bits, lane i is bit i
+        inline unsigned bits(bool m) { return m; }
+        /// Returns bits of the lanes of Pack<T> where p[i] != a
+        template<class T> inline unsigned neqBits(const uint32_t* p, uint32_t a) { 
+            return *p != a; 
+        }
+        /// Returns p[index] for every lane, the index is truncated to int32
+        template<class T> inline Pack<T> gather(const T* p, Pack<T> index) { 
+            return {p[int32_t(index.v)]}; 
+        }
+
+#if defined(__AVX512F__)
+        template<>
+        struct Pack<double>
+        {
+            static constexpr size_t width = 8;
+            typedef __mmask8 Mask;
+            __m512d v;
+            static Pack load(const double* p) { return {_mm512_loadu_pd(p)}; }
+            static Pack set1(double a) { return {_mm512_set1_pd(a)}; }
+            void store(double* p) const { _mm512_storeu_pd(p, v); }
+        };
+        inline Pack<double> operator+(Pack<double> a, Pack<double> b) {
+            return {_mm512_add_pd(a.v, b.v)};
+        }
+        inline Pack<double> operator-(Pack<double> a, Pack<double> b) {
+            return {_mm512_sub_pd(a.v, b.v)};
+        }
+        inline Pack<double> operator*(Pack<double> a, Pack<double> b) {
+            return {_mm512_mul_pd(a.v, b.v)};
+        }
+        inline Pack<double> fmadd(Pack<double> a, Pack<double> b, Pack<double> c) {
+            return {_mm512_fmadd_pd(a.v, b.v, c.v)};
+        }
+        inline __mmask8 cmpLt(Pack<double> a, Pack<double> b) {
+            return _mm512_cmp_pd_mask(a.v, b.v, _CMP_LT_OQ);
+        }
+        inline __mmask8 cmpGt(Pack<double> a, Pack<double> b) {
+            return _mm512_cmp_pd_mask(a.v, b.v, _CMP_GT_OQ);
+        }
+        inline Pack<double> select(__mmask8 m, Pack<double> a) {
+            return {_mm512_maskz_mov_pd(m, a.v)};
+        }
+        inline Pack<double> blend(__mmask8 m, Pack<double> a, Pack<double> b) {
+            return {_mm512_mask_blend_pd(m, a.v, b.v)};
+        }
+        inline unsigned bits(__mmask8 m) { return m; }
+        inline Pack<double> operator/(Pack<double> a, Pack<double> b) {
+            return {_mm512_div_pd(a.v, b.v)};
+        }
+        inline Pack<double> sqrt(Pack<double> a) { return {_mm512_sqrt_pd(a.v)}; }
+        inline Pack<double> floor(Pack<double> a) {
+            return {_mm512_roundscale_pd(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)};
+        }
+        inline Pack<double> min(Pack<double> a, Pack<double> b) { return {_mm512_min_pd(a.v, b.v)}; }
+        inline Pack<double> max(Pack<double> a, Pack<double> b) { return {_mm512_max_pd(a.v, b.v)}; }
+        template<> inline unsigned neqBits<double>(const uint32_t* p, uint32_t a) {
+            __m512i idx = _mm512_castsi256_si512(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+            return _mm512_cmpneq_epi32_mask(idx, _mm512_set1_epi32(int(a))) & 0xFF;
+        }
+        inline Pack<double> gather(const double* p, Pack<double> index) {
+            return {_mm512_i32gather_pd(_mm512_cvttpd_epi32(index.v), p, 8)};
+        }
+        /// Returns p[index] converted to double for every lane
+        inline Pack<double> gather(const float* p, Pack<double> index) {
+            return {_mm512_cvtps_pd(
+                _mm256_i32gather_ps(p, _mm512_cvttpd_epi32(index.v), 4))};
+        }
+
+        template<>
+        struct Pack<float>
+        {
+            static constexpr size_t width = 16;
+            typedef __mmask16 Mask;
+            __m512 v;
+            static Pack load(const float* p) { return {_mm512_loadu_ps(p)}; }
+            static Pack set1(float a) { return {_mm512_set1_ps(a)}; }
+            void store(float* p) const { _mm512_storeu_ps(p, v); }
+        };
+        inline Pack<float> operator+(Pack<float> a, Pack<float> b) {
+            return {_mm512_add_ps(a.v, b.v)};
+        }
+        inline Pack<float> operator-(Pack<float> a, Pack<float> b) {
+            return {_mm512_sub_ps(a.v, b.v)};
+        }
+        inline Pack<float> operator*(Pack<float> a, Pack<float> b) {
+            return {_mm512_mul_ps(a.v, b.v)};
+        }
+        inline Pack<float> fmadd(Pack<float> a, Pack<float> b, Pack<float> c) {
+            return {_mm512_fmadd_ps(a.v, b.v, c.v)};
+        }
+        inline __mmask16 cmpLt(Pack<float> a, Pack<float> b) {
+            return _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ);
+        }
+        inline __mmask16 cmpGt(Pack<float> a, Pack<float> b) {
+            return _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ);
+        }
+        inline Pack<float> select(__mmask16 m, Pack<float> a) {
+            return {_mm512_maskz_mov_ps(m, a.v)};
+        }
+        inline Pack<float> blend(__mmask16 m, Pack<float> a, Pack<float> b) {
+            return {_mm512_mask_blend_ps(m, a.v, b.v)};
+        }
+        inline unsigned bits(__mmask16 m) { return m; }
+        inline Pack<float> operator/(Pack<float> a, Pack<float> b) {
+            return {_mm512_div_ps(a.v, b.v)};
+        }
+        inline Pack<float> sqrt(Pack<float> a) { return {_mm512_sqrt_ps(a.v)}; }
+        inline Pack<float> floor(Pack<float> a) {
+            return {_mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)};
+        }
+        inline Pack<float> min(Pack<float> a, Pack<float> b) { return {_mm512_min_ps(a.v, b.v)}; }
+        inline Pack<float> max(Pack<float> a, Pack<float> b) { return {_mm512_max_ps(a.v, b.v)}; }
+        template<> inline unsigned neqBits<float>(const uint32_t* p, uint32_t a) {
+            __m512i idx = _mm512_loadu_si512(p);
+            return _mm512_cmpneq_epi32_mask(idx, _mm512_set1_epi32(int(a)));
+        }
+        inline Pack<float> gather(const float* p, Pack<float> index) {
+            return {_mm512_i32gather_ps(_mm512_cvttps_epi32(index.v), p, 4)};
+        }
+#elif defined(__AVX2__)
+        template<>
+        struct Pack<double>
+        {
+            static constexpr size_t width = 4;
+            typedef __m256d Mask;
+            __m256d v;
+            static Pack load(const double* p) { return {_mm256_loadu_pd(p)}; }
+            static Pack set1(double a) { return {_mm256_set1_pd(a)}; }
+            void store(double* p) const { _mm256_storeu_pd(p, v); }
+        };
+        inline Pack<double> operator+(Pack<double> a, Pack<double> b) {
+            return {_mm256_add_pd(a.v, b.v)};
+        }
+        inline Pack<double> operator-(Pack<double> a, Pack<double> b) {
+            return {_mm256_sub_pd(a.v, b.v)};
+        }
+        inline Pack<double> operator*(Pack<double> a, Pack<double> b) {
+            return {_mm256_mul_pd(a.v, b.v)};
+        }
+        inline Pack<double> fmadd(Pack<double> a, Pack<double> b, Pack<double> c) {
+#if defined(__FMA__)
+            return {_mm256_fmadd_pd(a.v, b.v, c.v)};
+#else
+            return {_mm256_add_pd(_mm256_mul_pd(a.v, b.v), c.v)};
+#endif
+        }
+        inline __m256d cmpLt(Pack<double> a, Pack<double> b) {
+            return _mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ);
+        }
+        inline __m256d cmpGt(Pack<double> a, Pack<double> b) {
+            return _mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ);
+        }
+        inline Pack<double> select(__m256d m, Pack<double> a) {
+            return {_mm256_and_pd(m, a.v)};
+        }
+        inline Pack<double> blend(__m256d m, Pack<double> a, Pack<double> b) {
+            return {_mm256_blendv_pd(a.v, b.v, m)};
+        }
+        inline unsigned bits(__m256d m) { return unsigned(_mm256_movemask_pd(m)); }
+        inline Pack<double> operator/(Pack<double> a, Pack<double> b) {
+            return {_mm256_div_pd(a.v, b.v)};
+        }
+        inline Pack<double> sqrt(Pack<double> a) { return {_mm256_sqrt_pd(a.v)}; }
+        inline Pack<double> floor(Pack<double> a) { return {_mm256_floor_pd(a.v)}; }
+        inline Pack<double> min(Pack<double> a, Pack<double> b) { return {_mm256_min_pd(a.v, b.v)}; }
+        inline Pack<double> max(Pack<double> a, Pack<double> b) { return {_mm256_max_pd(a.v, b.v)}; }
+        template<> inline unsigned neqBits<double>(const uint32_t* p, uint32_t a) {
+            __m128i eq = _mm_cmpeq_epi32(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_set1_epi32(int(a)));
+            return ~unsigned(_mm_movemask_ps(_mm_castsi128_ps(eq))) & 0xF;
+        }
+        inline Pack<double> gather(const double* p, Pack<double> index) {
+            return {_mm256_i32gather_pd(p, _mm256_cvttpd_epi32(index.v), 8)};
+        }
+        /// Returns p[index] converted to double for every lane
+        inline Pack<double> gather(const float* p, Pack<double> index) {
+            return {_mm256_cvtps_pd(_mm_i32gather_ps(p, _mm256_cvttpd_epi32(index.v), 4))};
+        }
+
+        template<>
+        struct Pack<float>
+        {
+            static constexpr size_t width = 8;
+            typedef __m256 Mask;
+            __m256 v;
+            static Pack load(const float* p) { return {_mm256_loadu_ps(p)}; }
+            static Pack set1(float a) { return {_mm256_set1_ps(a)}; }
+            void store(float* p) const { _mm256_storeu_ps(p, v); }
+        };
+        inline Pack<float> operator+(Pack<float> a, Pack<float> b) {
+            return {_mm256_add_ps(a.v, b.v)};
+        }
+        inline Pack<float> operator-(Pack<float> a, Pack<float> b) {
+            return {_mm256_sub_ps(a.v, b.v)};
+        }
+        inline Pack<float> operator*(Pack<float> a, Pack<float> b) {
+            return {_mm256_mul_ps(a.v, b.v)};
+        }
+        inline Pack<float> fmadd(Pack<float> a, Pack<float> b, Pack<float> c) {
+#if defined(__FMA__)
+            return {_mm256_fmadd_ps(a.v, b.v, c.v)};
+#else
+            return {_mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v)};
+#endif
+        }
+        inline __m256 cmpLt(Pack<float> a, Pack<float> b) {
+            return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ);
+        }
+        inline __m256 cmpGt(Pack<float> a, Pack<float> b) {
+            return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ);
+        }
+        inline Pack<float> select(__m256 m, Pack<float> a) {
+            return {_mm256_and_ps(m, a.v)};
+        }
+        inline Pack<float> blend(__m256 m, Pack<float> a, Pack<float> b) {
+            return {_mm256_blendv_ps(a.v, b.v, m)};
+        }
+        inline unsigned bits(__m256 m) { return unsigned(_mm256_movemask_ps(m)); }
+        inline Pack<float> operator/(Pack<float> a, Pack<float> b) {
+            return {_mm256_div_ps(a.v, b.v)};
+        }
+        inline Pack<float> sqrt(Pack<float> a) { return {_mm256_sqrt_ps(a.v)}; }
+        inline Pack<float> floor(Pack<float> a) { return {_mm256_floor_ps(a.v)}; }
+        inline Pack<float> min(Pack<float> a, Pack<float> b) { return {_mm256_min_ps(a.v, b.v)}; }
+        inline Pack<float> max(Pack<float> a, Pack<float> b) { return {_mm256_max_ps(a.v, b.v)}; }
+        template<> inline unsigned neqBits<float>(const uint32_t* p, uint32_t a) {
+            __m256i eq = _mm256_cmpeq_epi32(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), _mm256_set1_epi32(int(a)));
+            return ~unsigned(_mm256_movemask_ps(_mm256_castsi256_ps(eq))) & 0xFF;
+        }
+        inline Pack<float> gather(const float* p, Pack<float> index) {
+            return {_mm256_i32gather_ps(p, _mm256_cvttps_epi32(index.v), 4)};
+        }
+#else
+        /// Returns p[index] converted to double
+        inline Pack<double> gather(const float* p, Pack<double> index) { 
+            return {double(p[int32_t(index.v)])}; 
+        }
+#endif
+
+        /**
+         * @brief Sine and cosine of x, for |x| <= pi
+         * @details Series of x/4 up to x^13 (sine) and x^14 (cosine) with the double angle 
+         * formula applied twice, the error is below 1e-13.
+         */
+        template<class T> inline void sincos(Pack<T> x, Pack<T>& s, Pack<T>& c) {
+            typedef Pack<T> P;
+            P y = x*P::set1(T(0.25));
+            P y2 = y*y;
+            s = fmadd(y2, P::set1(T(1.0/6227020800.0)), P::set1(T(-1.0/39916800.0)));
+            s = fmadd(y2, s, P::set1(T(1.0/362880.0)));
+            s = fmadd(y2, s, P::set1(T(-1.0/5040.0)));
+            s = fmadd(y2, s, P::set1(T(1.0/120.0)));
+            s = fmadd(y2, s, P::set1(T(-1.0/6.0)));
+            s = fmadd(y2*y, s, y);
+            c = fmadd(y2, P::set1(T(-1.0/87178291200.0)), P::set1(T(1.0/479001600.0)));
+            c = fmadd(y2, c, P::set1(T(-1.0/3628800.0)));
+            c = fmadd(y2, c, P::set1(T(1.0/40320.0)));
+            c = fmadd(y2, c, P::set1(T(-1.0/720.0)));
+            c = fmadd(y2, c, P::set1(T(1.0/24.0)));
+            c = fmadd(y2, c, P::set1(T(-0.5)));
+            c = fmadd(y2, c, P::set1(T(1.0)));
+            for (int i = 0; i < 2; i++) {
+                P s2 = P::set1(T(2.0))*s*c;
+                c = (c - s)*(c + s);
+                s = s2;
+            }
+        }
+    }
+}
+
+#endif // PARFIS_SIMD_H
@@ -25,6 +25,11 @@ namespace parfis
         int loadCfgData() override;
         int loadSimData() override;
         int createCellsCylindrical();
+        int createCellsBox();
+        int orderCells();
+
+        /// Tiles of cells ordered along the curve (CellOrder) have 2^cellTileShift cells in z
+        static constexpr int cellTileShift = 3;
     };
 }
 
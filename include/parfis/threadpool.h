@@ -0,0 +1,53 @@
+#ifndef PARFIS_THREADPOOL_H
+#define PARFIS_THREADPOOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+namespace parfis
+{
+    /**
+     * @brief Pool of persistent threads that run the same task
+     * @details The task is called with the thread id, from 0 to size() - 1, where the
+     * thread id 0 is the calling thread. ThreadPool::run returns when all threads
+     * finished the task, so every call of run is followed by an implicit barrier.
+     * Threads wait on a condition variable between the calls, so there is no cost
+     * of starting threads at every evolve step.
+     */
+    struct ThreadPool
+    {
+        ThreadPool(int threadCount);
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ~ThreadPool();
+
+        /// Number of threads including the calling thread
+        int size() const { return int(m_threadVec.size()) + 1; }
+        void run(const std::function<void(int)>& task);
+
+    private:
+        void work(int threadId);
+
+        /// Worker threads (thread ids 1, 2, ...)
+        std::vector<std::thread> m_threadVec;
+        std::mutex m_mutex;
+        /// Notifies the workers that a new task is set
+        std::condition_variable m_startCv;
+        /// Notifies the calling thread that all workers are done
+        std::condition_variable m_doneCv;
+        /// Task that is executed
+        const std::function<void(int)>* m_pTask;
+        /// Counter of tasks, workers start when it changes
+        uint64_t m_generation;
+        /// Number of workers still running the task
+        int m_running;
+        /// Set when the pool is destroyed
+        bool m_stop;
+    };
+}
+
+#endif // PARFIS_THREADPOOL_H
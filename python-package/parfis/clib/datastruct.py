@@ -136,6 +136,15 @@ class Cell(Structure):
         ('pos', Vec3DClass(Type.cellPos_t))
     ]
 
+class CellColumn(Structure):
+    """Wrapper for the parfis::CellColumn class, cells of one (x, y) column
+    """
+    _fields_ = [
+        ('firstId', Type.cellId_t),
+        ('zFirst', Type.cellPos_t),
+        ('zCount', Type.cellPos_t)
+    ]
+
 class Specie(Structure):
     _fields_ = [
         ('id', c_uint32),
@@ -180,6 +189,12 @@ class PyVec_double(Structure, PyVecBase):
         ('size', c_size_t)
     ]
 
+class PyVec_float(Structure, PyVecBase):
+    _fields_ = [
+        ('ptr', POINTER(c_float)),
+        ('size', c_size_t)
+    ]
+
 class PyVec_int(Structure, PyVecBase):
     _fields_ = [
         ('ptr', POINTER(c_int)),
@@ -204,6 +219,12 @@ class PyVec_Cell(Structure, PyVecBase):
         ('size', c_size_t)
     ]
 
+class PyVec_CellColumn(Structure, PyVecBase):
+    _fields_ = [
+        ('ptr', POINTER(CellColumn)),
+        ('size', c_size_t)
+    ]
+
 class PyVec_uint32(Structure, PyVecBase):
     _fields_ = [
         ('ptr', POINTER(c_uint32)),
@@ -222,6 +243,12 @@ class PyVec_uint8(Structure, PyVecBase):
         ('size', c_size_t)
     ]
 
+class PyVec_uint64(Structure, PyVecBase):
+    _fields_ = [
+        ('ptr', POINTER(c_uint64)),
+        ('size', c_size_t)
+    ]
+
 class PyVec_Specie(Structure, PyVecBase):
     _fields_ = [
         ('ptr', POINTER(Specie)),
@@ -250,10 +277,14 @@ def PyVecClass(cType = c_char_p):
         return PyVec_int
     elif cType == c_double:
         return PyVec_double
+    elif cType == c_float:
+        return PyVec_float
     elif cType == c_uint32:
         return PyVec_uint32
     elif cType == c_uint8:
         return PyVec_uint8
+    elif cType == c_uint64:
+        return PyVec_uint64
     elif cType == State_float:
         return PyVec_State_float
     elif cType == State_double:
@@ -262,6 +293,8 @@ def PyVecClass(cType = c_char_p):
         return PyVec_Specie
     elif cType == Cell:
         return PyVec_Cell
+    elif cType == CellColumn:
+        return PyVec_CellColumn
     elif cType == Gas:
         return PyVec_Gas
     elif cType == PyGasCollision:
@@ -333,10 +366,20 @@ class PyCfgData(Structure):
     """PyCfgData(ctypes.Structure)
 
     Args:
-        geometry: Geometry type (0: cubical, 1: cylindrical)
+        geometry: Geometry type (0: box, 1: cylindrical)
         timestep: Timestep in seconds
         geometrySize: Pointer to Vec3D_double, size of geometry in meters
         cellCount: Pointer to Vec3D_int, number of cells
+        stateLayout: Memory layout of states (0: array of structures, 1: structure of arrays,
+            2: structure of arrays sorted in cell bins)
+        rebinPeriod: Number of steps between sorting states in cell bins
+        threads: Number of threads for pushing states
+        cellOrder: Order of cells in memory (0: loops over x, y and z, 1: Morton curve,
+            2: Hilbert curve)
+        colTableBins: Initial number of bins of the float collision tables (0: not used)
+        colTableMaxError: Maximal error of the float collision tables
+        crossSectionCache: Use binary cache files for the cross sections (0: no, 1: yes)
+        collisionCounterBins: Number of energy bins of the collision counters
     """
     _fields_ = [
         ('geometry', c_int),
@@ -348,13 +391,54 @@ class PyCfgData(Structure):
         ('specieNameVec', PyVecClass(c_char_p)),
         ('gasNameVec', PyVecClass(c_char_p)),
         ('gasCollisionNameVec', PyVecClass(c_char_p)),
-        ('gasCollisionFileNameVec', PyVecClass(c_char_p))
+        ('gasCollisionFileNameVec', PyVecClass(c_char_p)),
+        ('stateLayout', c_int),
+        ('rebinPeriod', c_int),
+        ('threads', c_int),
+        ('cellOrder', c_int),
+        ('colTableBins', c_int),
+        ('colTableMaxError', c_double),
+        ('crossSectionCache', c_int),
+        ('collisionCounterBins', c_int)
+    ]
+
+class PyStateSoA_float(Structure):
+    """Wrapper for the parfis::PyStateSoA class, used when states are 
+    stored as a structure of arrays (stateLayout = 1 or 2).
+    """
+    _fields_ = [
+        ('posX', PyVecClass(c_float)),
+        ('posY', PyVecClass(c_float)),
+        ('posZ', PyVecClass(c_float)),
+        ('velX', PyVecClass(c_float)),
+        ('velY', PyVecClass(c_float)),
+        ('velZ', PyVecClass(c_float)),
+        ('next', PyVecClass(Type.stateId_t)),
+        ('prev', PyVecClass(Type.stateId_t)),
+        ('cellId', PyVecClass(Type.cellId_t))
+    ]
+
+class PyStateSoA_double(Structure):
+    """Wrapper for the parfis::PyStateSoA class, used when states are 
+    stored as a structure of arrays (stateLayout = 1 or 2).
+    """
+    _fields_ = [
+        ('posX', PyVecClass(c_double)),
+        ('posY', PyVecClass(c_double)),
+        ('posZ', PyVecClass(c_double)),
+        ('velX', PyVecClass(c_double)),
+        ('velY', PyVecClass(c_double)),
+        ('velZ', PyVecClass(c_double)),
+        ('next', PyVecClass(Type.stateId_t)),
+        ('prev', PyVecClass(Type.stateId_t)),
+        ('cellId', PyVecClass(Type.cellId_t))
     ]
 
 class PySimData_float(Structure):
     _fields_ = [
         ('stateVec', PyVecClass(State_float)),
-        ('cellIdVec', PyVecClass(Type.cellId_t)),
+        ('cellColumnVec', PyVecClass(CellColumn)),
+        ('cellIndexShiftZ', c_int),
         ('cellIdAVec', PyVecClass(Type.cellId_t)),
         ('cellIdBVec', PyVecClass(Type.cellId_t)),
         ('specieVec', PyVecClass(Specie)),
@@ -363,13 +447,19 @@ class PySimData_float(Structure):
         ('headIdVec', PyVecClass(Type.stateId_t)),
         ('gasVec', PyVecClass(Gas)),
         ('pyGasCollisionVec', PyVecClass(PyGasCollision)),
-        ('pyGasCollisionProbVec', PyVecClass(PyFuncTable))
+        ('pyGasCollisionProbVec', PyVecClass(PyFuncTable)),
+        ('stateSoA', PyStateSoA_float),
+        ('binOffsetVec', PyVecClass(Type.stateId_t)),
+        ('nullCollisionCntVec', PyVecClass(c_uint64)),
+        ('collisionCntVec', PyVecClass(c_uint64)),
+        ('collisionEnergyLossVec', PyVecClass(c_double))
     ]
 
 class PySimData_double(Structure):
     _fields_ = [
         ('stateVec', PyVecClass(State_double)),
-        ('cellIdVec', PyVecClass(Type.cellId_t)),
+        ('cellColumnVec', PyVecClass(CellColumn)),
+        ('cellIndexShiftZ', c_int),
         ('cellIdAVec', PyVecClass(Type.cellId_t)),
         ('cellIdBVec', PyVecClass(Type.cellId_t)),
         ('specieVec', PyVecClass(Specie)),
@@ -378,7 +468,12 @@ class PySimData_double(Structure):
         ('headIdVec', PyVecClass(Type.stateId_t)),
         ('gasVec', PyVecClass(Gas)),
         ('pyGasCollisionVec', PyVecClass(PyGasCollision)),
-        ('pyGasCollisionProbVec', PyVecClass(PyFuncTable))
+        ('pyGasCollisionProbVec', PyVecClass(PyFuncTable)),
+        ('stateSoA', PyStateSoA_double),
+        ('binOffsetVec', PyVecClass(Type.stateId_t)),
+        ('nullCollisionCntVec', PyVecClass(c_uint64)),
+        ('collisionCntVec', PyVecClass(c_uint64)),
+        ('collisionEnergyLossVec', PyVecClass(c_double))
     ]
 
 def PySimDataClass():
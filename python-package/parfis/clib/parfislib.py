@@ -4,7 +4,7 @@ from ctypes import *
 from importlib import reload
 
 # import .datastruct as ds
-from .datastruct import PyCfgData, PySimDataClass, Vec3DBase, Type
+from .datastruct import PyCfgData, PySimDataClass, Vec3DBase, Type, Const
 # import datastruct as ds
 
 class Parfis:
@@ -12,6 +12,9 @@ class Parfis:
     lib = None
     libPath = None
 
+    # C type of the parfis::api::EvolveCallback
+    EvolveCallback = CFUNCTYPE(c_int, c_uint32, c_uint64)
+
     currPath = os.path.dirname(os.path.abspath(os.path.expanduser(__file__)))
     
     @staticmethod
@@ -146,9 +149,15 @@ class Parfis:
         Parfis.lib.runCommandChain.argtypes = [c_uint32, c_char_p]
         Parfis.lib.runCommandChain.restype = c_int
 
+        Parfis.lib.evolveSteps.argtypes = [c_uint32, c_uint64, c_uint64, Parfis.EvolveCallback]
+        Parfis.lib.evolveSteps.restype = c_int
+
         Parfis.lib.setConfigFromFile.argtypes = [c_uint32, c_char_p]
         Parfis.lib.setConfigFromFile.restype = c_int
 
+        Parfis.lib.resetCollisionCounter.argtypes = [c_uint32]
+        Parfis.lib.resetCollisionCounter.restype = c_int
+
     @staticmethod
     def unload_lib():
         print(f"Unload lib: {Parfis.libPath[len(Parfis.currPath)+1:]}")
@@ -236,15 +245,70 @@ class Parfis:
     def runCommandChain(id: int, cmdStr: str) -> int:
         return Parfis.lib.runCommandChain(id, cmdStr.encode())
 
+    @staticmethod
+    def evolveSteps(id: int, stepCount: int, callbackPeriod: int = 0, callback = None) -> int:
+        """ Wrapper for parfis::api::evolveSteps(id, stepCount, callbackPeriod, callback).
+        Runs the evolve command chain stepCount times inside the library.
+
+        Args:
+            id (int): Parfis id.
+            stepCount (int): Number of evolve steps.
+            callbackPeriod (int): The callback is called every callbackPeriod steps.
+            callback (function): Called as callback(id, evolveCnt), evolving stops
+                if it returns a nonzero value.
+
+        Returns:
+            int: Zero on success
+        """
+        if callback is None:
+            cfunc = Parfis.EvolveCallback()
+        else:
+            cfunc = Parfis.EvolveCallback(lambda i, cnt: int(callback(i, cnt) or 0))
+        return Parfis.lib.evolveSteps(id, stepCount, callbackPeriod, cfunc)
+
     @staticmethod
     def setConfigFromFile(id: int, fileName: str) -> int:
         return Parfis.lib.setConfigFromFile(id, fileName.encode())
 
+    @staticmethod
+    def resetCollisionCounter(id: int) -> int:
+        """ Wrapper for parfis::api::resetCollisionCounter(id).
+        Sets the collision counters to zero, the counters are read from
+        PySimData (nullCollisionCntVec, collisionCntVec and 
+        collisionEnergyLossVec) after setPySimData.
+
+        Args:
+            id (int): Parfis id.
+
+        Returns:
+            int: Zero on success
+        """
+        return Parfis.lib.resetCollisionCounter(id)
+
     
 def getAbsoluteCellId(cellCount: Vec3DBase, node: Vec3DBase) -> int:
     return cellCount.z * (cellCount.y * node.x + node.y) + node.z
 
 
+def getCellId(ptrSimData, cellCount: Vec3DBase, node: Vec3DBase) -> int:
+    """Cell id of the cell at position node, same as parfis::CellIndex::cellId.
+
+    Args:
+        ptrSimData: PySimData with cellColumnVec and cellIndexShiftZ
+        cellCount: Number of cells in every direction
+        node: Cell position
+
+    Returns:
+        int: Cell id, Const.noCellId if there is no cell at the position
+    """
+    shift = ptrSimData.cellIndexShiftZ
+    tileCnt = ((cellCount.z - 1) >> shift) + 1
+    col = ptrSimData.cellColumnVec.ptr[
+        (cellCount.y * node.x + node.y) * tileCnt + (node.z >> shift)]
+    dz = node.z - col.zFirst
+    return col.firstId + dz if 0 <= dz < col.zCount else Const.noCellId
+
+
 if __name__ == "__main__":
 
     Parfis.load_lib("Copy")
@@ -93,6 +93,7 @@ class TestApi(unittest.TestCase):
         self.assertEqual((20, 20, 400),ptrCfgData.cellCount[0].asTuple())
         self.assertEqual(1,ptrCfgData.specieNameVec.size)
         self.assertEqual(["a"],ptrCfgData.specieNameVec.asList())
+        self.assertEqual(1,ptrCfgData.threads)
 
     def test_reconfiguration(self) -> None:
         '''Check reconfiguration of specie data
@@ -158,7 +159,16 @@ class TestApi(unittest.TestCase):
         self.assertEqual("electron", ptrSimData.specieVec.ptr[0].name.decode())
         self.assertEqual(10, ptrSimData.specieVec.ptr[0].statesPerCell)
         numStatesCyl = ptrSimData.stateVec.size
-        numCells = ptrSimData.cellIdVec.size
+        cellCount = ptrCfgData.cellCount[0]
+        numCells = cellCount.x * cellCount.y * cellCount.z
+        self.assertEqual(cellCount.x * cellCount.y, ptrSimData.cellColumnVec.size)
+        cellPos = pfs.Vec3DClass(pfs.Type.cellPos_t)(x=10, y=10, z=10)
+        cellId = pfs.getCellId(ptrSimData, cellCount, cellPos)
+        self.assertEqual(10, ptrSimData.cellVec.ptr[cellId].pos.z)
+        cellPos.x = 0
+        cellPos.y = 0
+        self.assertEqual(pfs.Const.noCellId, 
+            pfs.getCellId(ptrSimData, cellCount, cellPos))
         numStatesCub = numCells * ptrSimData.specieVec.ptr[0].statesPerCell
         stateRatio = numStatesCyl/numStatesCub
         relativeDifference = abs(volRatio - stateRatio)/(0.5*(volRatio + stateRatio))
@@ -179,6 +189,81 @@ class TestApi(unittest.TestCase):
                 break
         self.assertEqual(retval, 0)
 
+    def test_stateLayoutSoA(self) -> None:
+        '''Create states stored as structure of arrays and push them
+        '''
+        id = Parfis.newParfis()
+        Parfis.setConfig(id, "system.geometrySize = [0.01, 0.01, 0.02]")
+        Parfis.setConfig(id, "particle.stateLayout = 1")
+        Parfis.loadCfgData(id)
+        Parfis.loadSimData(id)
+        Parfis.runCommandChain(id, "create")
+        Parfis.setPyCfgData(id)
+        ptrCfgData = Parfis.getPyCfgData(id)
+        self.assertEqual(1, ptrCfgData.stateLayout)
+        Parfis.setPySimData(id)
+        ptrSimData = Parfis.getPySimData(id)
+        self.assertEqual(0, ptrSimData.stateVec.size)
+        self.assertGreater(ptrSimData.stateSoA.posX.size, 0)
+        self.assertEqual(ptrSimData.stateSoA.posX.size, ptrSimData.stateSoA.next.size)
+        self.assertEqual(0, Parfis.runCommandChain(id, "evolve"))
+
+    def test_stateLayoutBinned(self) -> None:
+        '''Create states sorted in cell bins and check the bin offsets
+        '''
+        id = Parfis.newParfis()
+        Parfis.setConfig(id, "system.geometrySize = [0.01, 0.01, 0.02]")
+        Parfis.setConfig(id, "particle.stateLayout = 2")
+        Parfis.loadCfgData(id)
+        Parfis.loadSimData(id)
+        Parfis.runCommandChain(id, "create")
+        Parfis.setPySimData(id)
+        ptrSimData = Parfis.getPySimData(id)
+        numCells = ptrSimData.cellVec.size
+        self.assertEqual(numCells + 1, ptrSimData.binOffsetVec.size)
+        self.assertEqual(ptrSimData.stateSoA.posX.size, ptrSimData.binOffsetVec.ptr[numCells])
+        self.assertEqual(ptrSimData.stateSoA.posX.size, ptrSimData.stateSoA.cellId.size)
+        for i in range(20):
+            self.assertEqual(0, Parfis.runCommandChain(id, "evolve"))
+
+    def test_evolveSteps(self) -> None:
+        '''Run evolve steps inside the library with a callback every 5 steps
+        '''
+        id = Parfis.newParfis()
+        Parfis.setConfig(id, "system.geometrySize = [0.01, 0.01, 0.02]")
+        Parfis.loadCfgData(id)
+        Parfis.loadSimData(id)
+        Parfis.runCommandChain(id, "create")
+        self.assertEqual(0, Parfis.evolveSteps(id, 10))
+        evolveCnt = []
+        def callback(cbId, cnt):
+            evolveCnt.append(cnt)
+            return 1 if cnt >= 25 else 0
+        self.assertEqual(1, Parfis.evolveSteps(id, 100, 5, callback))
+        self.assertEqual([15, 20, 25], evolveCnt)
+
+    def test_collisionCounter(self) -> None:
+        '''Check sizes of the collision counters and reset them
+        '''
+        id = Parfis.newParfis()
+        Parfis.setConfig(id, "system.geometrySize = [0.01, 0.01, 0.02]")
+        Parfis.setConfig(id, "particle.collisionCounterBins = 4")
+        Parfis.loadCfgData(id)
+        Parfis.loadSimData(id)
+        Parfis.runCommandChain(id, "create")
+        Parfis.setPyCfgData(id)
+        self.assertEqual(4, Parfis.getPyCfgData(id).collisionCounterBins)
+        self.assertEqual(0, Parfis.evolveSteps(id, 2))
+        self.assertEqual(0, Parfis.resetCollisionCounter(id))
+        Parfis.setPySimData(id)
+        ptrSimData = Parfis.getPySimData(id)
+        self.assertEqual(4*ptrSimData.specieVec.size, ptrSimData.nullCollisionCntVec.size)
+        self.assertEqual(4*ptrSimData.pyGasCollisionVec.size, ptrSimData.collisionCntVec.size)
+        self.assertEqual(ptrSimData.collisionCntVec.size, 
+            ptrSimData.collisionEnergyLossVec.size)
+        for i in range(ptrSimData.nullCollisionCntVec.size):
+            self.assertEqual(0, ptrSimData.nullCollisionCntVec.ptr[i])
+
 if __name__ == '__main__':
 
     unittest.main()
\ No newline at end of file
@@ -1,10 +1,20 @@
 #include <sstream>
 #include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#if !defined(_MSC_VER)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "parfis.h"
 #include "datastruct.h"
 #include "global.h"
 #include "system.h"
 #include "particle.h"
+#include "simd.h"
 
 template<>
 void parfis::Param<std::string>::setValueVec(const std::string& valstr) 
@@ -228,6 +238,14 @@ int parfis::CfgData::setPyCfgData()
     pyCfgData.cellSize = &cellSize;
     pyCfgData.periodicBoundary = &periodicBoundary;
     pyCfgData.cellCount = &cellCount;
+    pyCfgData.stateLayout = stateLayout;
+    pyCfgData.rebinPeriod = rebinPeriod;
+    pyCfgData.threads = threads;
+    pyCfgData.cellOrder = cellOrder;
+    pyCfgData.colTableBins = colTableBins;
+    pyCfgData.colTableMaxError = colTableMaxError;
+    pyCfgData.crossSectionCache = crossSectionCache;
+    pyCfgData.collisionCounterBins = collisionCounterBins;
     // Reserve space in the PyVecContainer::pyStrVec for strings
     auto sizeRes = 0;
     sizeRes += specieNameVec.size();
@@ -255,7 +273,8 @@ int parfis::CfgData::setPyCfgData()
 int parfis::SimData::setPySimData()
 {
     pySimData.stateVec = stateVec;
-    pySimData.cellIdVec = cellIdVec;
+    pySimData.cellColumnVec = cellIndex.columnVec;
+    pySimData.cellIndexShiftZ = cellIndex.shiftZ;
     pySimData.cellIdAVec = cellIdAVec;
     pySimData.cellIdBVec = cellIdBVec;
     pySimData.specieVec = specieVec;
@@ -278,10 +297,249 @@ int parfis::SimData::setPySimData()
     }
     // Get references
     pySimData.pyGasCollisionProbVec = pyGasCollisionProbVec;
+    pySimData.stateSoA = stateSoA;
+    pySimData.binOffsetVec = binOffsetVec;
+    pySimData.nullCollisionCntVec = collisionCounter.nullCollisionCntVec;
+    pySimData.collisionCntVec = collisionCounter.collisionCntVec;
+    pySimData.collisionEnergyLossVec = collisionCounter.energyLossVec;
 
     return 0;
 }
 
+/**
+ * @brief Reserves space for states
+ * @param n number of states
+ * @param binned if true reserve cellId instead of the cell linking arrays
+ */
+void parfis::StateSoA::reserve(size_t n, bool binned)
+{
+    posX.reserve(n);
+    posY.reserve(n);
+    posZ.reserve(n);
+    velX.reserve(n);
+    velY.reserve(n);
+    velZ.reserve(n);
+    if (binned) {
+        cellId.reserve(n);
+    }
+    else {
+        next.reserve(n);
+        prev.reserve(n);
+    }
+}
+
+void parfis::StateSoA::clear()
+{
+    posX.clear();
+    posY.clear();
+    posZ.clear();
+    velX.clear();
+    velY.clear();
+    velZ.clear();
+    next.clear();
+    prev.clear();
+    cellId.clear();
+}
+
+void parfis::StateSoA::push_back(const State& state)
+{
+    posX.push_back(state.pos.x);
+    posY.push_back(state.pos.y);
+    posZ.push_back(state.pos.z);
+    velX.push_back(state.vel.x);
+    velY.push_back(state.vel.y);
+    velZ.push_back(state.vel.z);
+    next.push_back(state.next);
+    prev.push_back(state.prev);
+}
+
+/**
+ * @brief Adds state for StateLayout::Binned, without the cell linking data
+ * @param state state to copy from
+ * @param cell id of the cell of the state
+ */
+void parfis::StateSoA::push_back(const State& state, cellId_t cell)
+{
+    posX.push_back(state.pos.x);
+    posY.push_back(state.pos.y);
+    posZ.push_back(state.pos.z);
+    velX.push_back(state.vel.x);
+    velY.push_back(state.vel.y);
+    velZ.push_back(state.vel.z);
+    cellId.push_back(cell);
+}
+
+/**
+ * @brief Gathers the components of a state in the State structure
+ * @param id id of the state
+ * @return State with position, velocity and cell links of the state
+ */
+parfis::State parfis::StateSoA::getState(stateId_t id) const
+{
+    State state;
+    state.next = next.size() ? next[id] : Const::noStateId;
+    state.prev = prev.size() ? prev[id] : Const::noStateId;
+    state.pos = {posX[id], posY[id], posZ[id]};
+    state.vel = {velX[id], velY[id], velZ[id]};
+    return state;
+}
+
+/**
+ * @brief Scatters the position and velocity of the state to the arrays
+ * @details Links to the next and previous states are not changed.
+ * @param id id of the state
+ * @param state state to copy from
+ */
+void parfis::StateSoA::setState(stateId_t id, const State& state)
+{
+    posX[id] = state.pos.x;
+    posY[id] = state.pos.y;
+    posZ[id] = state.pos.z;
+    velX[id] = state.vel.x;
+    velY[id] = state.vel.y;
+    velZ[id] = state.vel.z;
+}
+
+void parfis::WallBatch::clear()
+{
+    stateId.clear();
+    cellId.clear();
+    posX.clear();
+    posY.clear();
+    velX.clear();
+    velY.clear();
+}
+
+void parfis::WallBatch::push_back(stateId_t id, cellId_t cell, double rx, double ry, 
+    double vx, double vy)
+{
+    stateId.push_back(id);
+    cellId.push_back(cell);
+    posX.push_back(rx);
+    posY.push_back(ry);
+    velX.push_back(vx);
+    velY.push_back(vy);
+}
+
+/**
+ * @brief Builds the columns (tiles) from the cells
+ * @param cellVec cells, the cells of a tile must have consecutive ids ordered in z
+ * @param cellCount number of cells in every direction
+ * @param shift tiles have 2^shift cells in z, the default is one tile per column
+ * @return Zero on success, one if the cells of a tile are not consecutive
+ */
+int parfis::CellIndex::build(const std::vector<Cell>& cellVec, const Vec3D<int>& cellCount, 
+    int shift)
+{
+    countY = cellCount.y;
+    shiftZ = shift;
+    tileCnt = ((cellCount.z - 1) >> shiftZ) + 1;
+    columnVec.assign(size_t(cellCount.x)*cellCount.y*tileCnt, {0, 0, 0});
+    for (size_t i = 0; i < cellVec.size(); i++) {
+        const Vec3D<cellPos_t>& pos = cellVec[i].pos;
+        CellColumn& col = columnVec[(size_t(pos.x)*countY + pos.y)*tileCnt + (pos.z >> shiftZ)];
+        if (col.zCount == 0) {
+            col.firstId = cellId_t(i);
+            col.zFirst = pos.z;
+        }
+        else if (cellId_t(i) != col.firstId + col.zCount || pos.z != col.zFirst + col.zCount) {
+            columnVec.clear();
+            return 1;
+        }
+        col.zCount++;
+    }
+    return 0;
+}
+
+void parfis::CollisionBatch::clear()
+{
+    stateId.clear();
+    velX.clear();
+    velY.clear();
+    velZ.clear();
+    velSq.clear();
+    rand.clear();
+    prob.clear();
+    cosIndex.clear();
+    lossSq.clear();
+    massRatio.clear();
+    azimuth.clear();
+    gasCollisionId.clear();
+}
+
+void parfis::CollisionBatch::resize(size_t n)
+{
+    stateId.resize(n);
+    velX.resize(n);
+    velY.resize(n);
+    velZ.resize(n);
+    velSq.resize(n);
+    rand.resize(n);
+    prob.resize(n);
+    cosIndex.resize(n);
+    lossSq.resize(n);
+    massRatio.resize(n);
+    azimuth.resize(n);
+    gasCollisionId.resize(n);
+}
+
+void parfis::CollisionBatch::push_back(stateId_t id, double vx, double vy, double vz, double r)
+{
+    stateId.push_back(id);
+    velX.push_back(vx);
+    velY.push_back(vy);
+    velZ.push_back(vz);
+    velSq.push_back(vx*vx + vy*vy + vz*vz);
+    rand.push_back(r);
+    prob.push_back(0);
+}
+
+/// Copies the state at src to dst, used for removing states from the batch (before the 
+/// scattering, so the scattering data is not copied)
+void parfis::CollisionBatch::copy(size_t dst, size_t src)
+{
+    stateId[dst] = stateId[src];
+    velX[dst] = velX[src];
+    velY[dst] = velY[src];
+    velZ[dst] = velZ[src];
+    velSq[dst] = velSq[src];
+    rand[dst] = rand[src];
+    prob[dst] = prob[src];
+}
+
+/**
+ * @brief Sets the number of bins and the size of the counters, and sets counters to zero
+ * @param bins number of energy bins
+ * @param specieCnt number of species
+ * @param gasCollisionCnt number of gas collisions
+ */
+void parfis::CollisionCounter::reset(int bins, size_t specieCnt, size_t gasCollisionCnt)
+{
+    binCnt = bins;
+    nullCollisionCntVec.assign(specieCnt*bins, 0);
+    collisionCntVec.assign(gasCollisionCnt*bins, 0);
+    energyLossVec.assign(gasCollisionCnt*bins, 0);
+}
+
+/// Sets counters to zero, the size is not changed
+void parfis::CollisionCounter::clear()
+{
+    std::fill(nullCollisionCntVec.begin(), nullCollisionCntVec.end(), 0);
+    std::fill(collisionCntVec.begin(), collisionCntVec.end(), 0);
+    std::fill(energyLossVec.begin(), energyLossVec.end(), 0);
+}
+
+/// Adds counters of the same size
+void parfis::CollisionCounter::add(const CollisionCounter& counter)
+{
+    for (size_t i = 0; i < nullCollisionCntVec.size(); i++)
+        nullCollisionCntVec[i] += counter.nullCollisionCntVec[i];
+    for (size_t i = 0; i < collisionCntVec.size(); i++)
+        collisionCntVec[i] += counter.collisionCntVec[i];
+    for (size_t i = 0; i < energyLossVec.size(); i++)
+        energyLossVec[i] += counter.energyLossVec[i];
+}
+
 /**
  * @brief Initializes Domain from DEFAULT_INITIALIZATION_STRING
  * @param cstr initialization string is in the format key=value<type>(range). Value 
@@ -320,16 +578,42 @@ int parfis::Domain::initialize(const std::string& cstr)
 /**
  * @brief Loads data from the defined file name and based on 
  * the object type.
- * 
+ * @param fileName name of the data file
+ * @param cache use the binary cache file
  * @return int Zero on success
  */
-int parfis::FuncTable::loadData(const std::string& fileName)
+int parfis::FuncTable::loadData(const std::string& fileName, bool cache)
 {
-    std::ifstream infile(fileName);
-    std::string line;
+    std::string content;
+    Global::readFile(fileName, content);
+    return loadData(fileName, content, Global::hash(content.data(), content.size()), cache);
+}
+
+/**
+ * @brief Loads data from the content of the data file, that is already read
+ * @details With the cache, data is read from the binary file with the name of the data 
+ * file and FuncTable::cacheExtension if the hash of the data file matches, otherwise 
+ * the data file is parsed and the cache file is written. Errors of the cache file are 
+ * not errors of loading, the data file is parsed instead.
+ * @param fileName name of the data file
+ * @param content content of the data file
+ * @param sourceHash hash of the content (Global::hash)
+ * @param cache use the binary cache file
+ * @return int Zero on success
+ */
+int parfis::FuncTable::loadData(const std::string& fileName, const std::string& content, 
+    uint64_t sourceHash, bool cache)
+{
+    std::string cacheName = fileName + cacheExtension;
     rowCnt = 1;
+    if (cache && readCache(cacheName, sourceHash) == 0)
+        return setIndex();
+    std::istringstream infile(content);
+    std::string line;
     colCnt = 0;
     while (std::getline(infile, line)) {
+        if (line.size() && line.back() == '\r')
+            line.pop_back();
         std::istringstream iss(line);
         if (line[0] == '#') {
             // Find nbins
@@ -356,10 +640,388 @@ int parfis::FuncTable::loadData(const std::string& fileName)
     }
     if (colCnt != xVec.size())
         return 3;
+    if (cache)
+        writeCache(cacheName, sourceHash);
+
+    return setIndex();
+}
+
+/**
+ * @brief Reads ranges, nbins, xVec and yVec from the binary cache file
+ * @details The file is memory mapped (read at once on Windows), and the data is used 
+ * only if the version, the hash of the data file, the sizes and the checksum match.
+ * @param cacheName name of the cache file
+ * @param sourceHash hash of the data file
+ * @return Zero on success
+ */
+int parfis::FuncTable::readCache(const std::string& cacheName, uint64_t sourceHash)
+{
+#if defined(_MSC_VER)
+    std::string content;
+    if (Global::readFile(cacheName, content))
+        return 1;
+    const char* pData = content.data();
+    size_t size = content.size();
+#else
+    int fd = open(cacheName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return 1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < off_t(sizeof(CacheHeader))) {
+        close(fd);
+        return 1;
+    }
+    size_t size = size_t(st.st_size);
+    void* pMap = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED)
+        return 1;
+    const char* pData = static_cast<const char*>(pMap);
+#endif
+    int retVal = 1;
+    CacheHeader header;
+    if (size >= sizeof(CacheHeader)) {
+        memcpy(&header, pData, sizeof(CacheHeader));
+        const char* p = pData + sizeof(CacheHeader);
+        uint64_t doubleCnt = header.rangeCnt + header.xCnt + header.yCnt;
+        if (memcmp(header.magic, "PFXSEC\0\0", 8) == 0 && 
+            header.version == cacheVersion && header.sourceHash == sourceHash &&
+            size == sizeof(CacheHeader) + 
+                doubleCnt*sizeof(double) + header.nbinsCnt*sizeof(int32_t) &&
+            header.checksum == Global::hash(p, size - sizeof(CacheHeader))) {
+            colCnt = header.pointCnt;
+            ranges.resize(header.rangeCnt);
+            xVec.resize(header.xCnt);
+            yVec.resize(header.yCnt);
+            nbins.resize(header.nbinsCnt);
+            memcpy(ranges.data(), p, ranges.size()*sizeof(double));
+            p += ranges.size()*sizeof(double);
+            memcpy(xVec.data(), p, xVec.size()*sizeof(double));
+            p += xVec.size()*sizeof(double);
+            memcpy(yVec.data(), p, yVec.size()*sizeof(double));
+            p += yVec.size()*sizeof(double);
+            for (auto& nbin : nbins) {
+                int32_t n;
+                memcpy(&n, p, sizeof(int32_t));
+                nbin = n;
+                p += sizeof(int32_t);
+            }
+            retVal = 0;
+        }
+    }
+#if !defined(_MSC_VER)
+    munmap(pMap, size);
+#endif
+    return retVal;
+}
 
+/**
+ * @brief Writes ranges, nbins, xVec and yVec to the binary cache file
+ * @details Data is written to a temporary file that is renamed to the cache file, so 
+ * the cache file is never read while it is written.
+ * @param cacheName name of the cache file
+ * @param sourceHash hash of the data file
+ * @return Zero on success
+ */
+int parfis::FuncTable::writeCache(const std::string& cacheName, uint64_t sourceHash) const
+{
+    std::string data;
+    data.append(reinterpret_cast<const char*>(ranges.data()), ranges.size()*sizeof(double));
+    data.append(reinterpret_cast<const char*>(xVec.data()), xVec.size()*sizeof(double));
+    data.append(reinterpret_cast<const char*>(yVec.data()), yVec.size()*sizeof(double));
+    for (auto nbin : nbins) {
+        int32_t n = nbin;
+        data.append(reinterpret_cast<const char*>(&n), sizeof(int32_t));
+    }
+    CacheHeader header;
+    memcpy(header.magic, "PFXSEC\0\0", 8);
+    header.version = cacheVersion;
+    header.pointCnt = colCnt;
+    header.sourceHash = sourceHash;
+    header.rangeCnt = ranges.size();
+    header.nbinsCnt = nbins.size();
+    header.xCnt = xVec.size();
+    header.yCnt = yVec.size();
+    header.checksum = Global::hash(data.data(), data.size());
+    std::string tmpName = cacheName + ".tmp" + 
+        std::to_string(reinterpret_cast<uintptr_t>(this));
+    {
+        std::ofstream outfile(tmpName, std::ios::binary);
+        if (!outfile.good())
+            return 1;
+        outfile.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+        outfile.write(data.data(), data.size());
+        if (!outfile.good()) {
+            outfile.close();
+            std::remove(tmpName.c_str());
+            return 1;
+        }
+    }
+#if defined(_MSC_VER)
+    std::remove(cacheName.c_str());
+#endif
+    if (std::rename(tmpName.c_str(), cacheName.c_str()) != 0) {
+        std::remove(tmpName.c_str());
+        return 1;
+    }
     return 0;
 }
 
+/**
+ * @brief Sets the data for the constant time lookup (rangeStart, rangeOffset, idx)
+ * @details Points of every range are equidistant, and the first point of a range is 
+ * the end of the previous range. A table without ranges is one range over all points.
+ * @return Zero on success
+ */
+int parfis::FuncTable::setIndex()
+{
+    rangeStart.clear();
+    rangeOffset.clear();
+    idx.clear();
+    if (xVec.size() == 0)
+        return 1;
+    yStride = int(yVec.size()/xVec.size());
+    if (ranges.size() == 0 || ranges.size() != nbins.size()) {
+        rangeStart.push_back(xVec[0]);
+        rangeOffset.push_back(0);
+        idx.push_back(xVec.size() > 1 ? (xVec.size() - 1)/(xVec.back() - xVec[0]) : 0.0);
+        return 0;
+    }
+    int offset = 0;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (offset + nbins[i] > int(xVec.size()))
+            return 2;
+        rangeStart.push_back(xVec[offset]);
+        rangeOffset.push_back(offset);
+        idx.push_back(nbins[i]/(ranges[i] - xVec[offset]));
+        offset += nbins[i];
+    }
+    return 0;
+}
+
+/**
+ * @brief Evaluates the table for an array of x values
+ * @details Vectorized version of FuncTable::eval. Range parameters are blended for 
+ * every range start that is not larger than x, and the y values are loaded with 
+ * a SIMD gather.
+ * @param x array of x values
+ * @param n number of values
+ * @param y array for the results
+ * @param col column of the y values
+ */
+void parfis::FuncTable::evalBatch(const double* x, size_t n, double* y, int col) const
+{
+    typedef simd::Pack<double> Pack;
+    size_t i = 0;
+    Pack posMax = Pack::set1(double(xVec.size() - 1));
+    Pack stride = Pack::set1(double(yStride));
+    Pack column = Pack::set1(double(col));
+    for (; i + Pack::width <= n; i += Pack::width) {
+        Pack xp = Pack::load(x + i);
+        Pack start = Pack::set1(rangeStart[0]);
+        Pack scale = Pack::set1(idx[0]);
+        Pack offset = Pack::set1(double(rangeOffset[0]));
+        for (size_t r = 1; r < rangeStart.size(); r++) {
+            Pack rs = Pack::set1(rangeStart[r]);
+            auto below = simd::cmpLt(xp, rs);
+            start = simd::blend(below, rs, start);
+            scale = simd::blend(below, Pack::set1(idx[r]), scale);
+            offset = simd::blend(below, Pack::set1(double(rangeOffset[r])), offset);
+        }
+        Pack pos = simd::fmadd(xp - start, scale, offset);
+        pos = simd::min(simd::max(pos, Pack::set1(0.0)), posMax);
+        simd::gather(yVec.data(), simd::fmadd(simd::floor(pos), stride, column)).store(y + i);
+    }
+    for (; i < n; i++)
+        y[i] = eval(x[i], col);
+}
+
+/**
+ * @brief Resamples the cumulative probabilities from the table to uniform bins
+ * @details The value of a bin is the linear interpolation of the table in the middle 
+ * of the bin. The error is the largest difference between the values of the table 
+ * points with x from 0 to 1 and the values of the bins they fall in.
+ * @param ftab table with the velocity squared (in maxVel^2) on the x-axis
+ * @param bins number of bins for x from 0 to 1
+ * @return Maximal absolute difference from the table
+ */
+double parfis::ColProbTable::resample(const FuncTable& ftab, int bins)
+{
+    binCnt = bins;
+    colCnt = ftab.yStride;
+    // Cache line is 16 floats
+    stride = 1;
+    while (stride < colCnt)
+        stride *= 2;
+    if (stride > 16)
+        stride = (colCnt + 15)/16*16;
+    prob.assign(size_t(stride)*binCnt, 0.0f);
+    size_t last = ftab.xVec.size() - 1;
+    for (int b = 0; b < binCnt; b++) {
+        double x = (b + 0.5)/binCnt;
+        size_t k = std::min(ftab.xIndex(x), last - 1);
+        double t = (x - ftab.xVec[k])/(ftab.xVec[k + 1] - ftab.xVec[k]);
+        t = std::min(std::max(t, 0.0), 1.0);
+        for (int j = 0; j < colCnt; j++)
+            prob[size_t(b)*stride + j] = float(
+                (1.0 - t)*ftab.yVec[k*colCnt + j] + t*ftab.yVec[(k + 1)*colCnt + j]);
+    }
+    maxError = 0;
+    for (size_t k = 0; k <= last && ftab.xVec[k] <= 1.0; k++) {
+        const float* p = bin(ftab.xVec[k]);
+        for (int j = 0; j < colCnt; j++)
+            maxError = std::max(maxError, std::abs(ftab.yVec[k*colCnt + j] - p[j]));
+    }
+    return maxError;
+}
+
+/**
+ * @brief Evaluates the table for an array of velocities squared, with SIMD gathers
+ * @param x array of velocities squared (in maxVel^2)
+ * @param n number of values
+ * @param y array for the results
+ * @param col column of the cumulative probability
+ */
+void parfis::ColProbTable::evalBatch(const double* x, size_t n, double* y, int col) const
+{
+    typedef simd::Pack<double> Pack;
+    size_t i = 0;
+    Pack bins = Pack::set1(double(binCnt));
+    Pack binMax = Pack::set1(double(binCnt - 1));
+    Pack stridePack = Pack::set1(double(stride));
+    Pack column = Pack::set1(double(col));
+    for (; i + Pack::width <= n; i += Pack::width) {
+        Pack b = simd::min(simd::floor(Pack::load(x + i)*bins), binMax);
+        simd::gather(prob.data(), simd::fmadd(b, stridePack, column)).store(y + i);
+    }
+    for (; i < n; i++)
+        y[i] = bin(x[i])[col];
+}
+
+std::mutex parfis::FuncTableRegistry::m_mutex;
+std::map<std::string, std::weak_ptr<const parfis::FuncTable>> 
+    parfis::FuncTableRegistry::m_tableMap;
+
+/**
+ * @brief Returns the table of the file, loads it if no Parfis object uses it
+ * @details The file is hashed on every call, so the table is shared only if the 
+ * content is the same. Tables that failed to load are not shared.
+ * @param fileName name of the data file
+ * @param type type of the table (0: linear, 1: nonlinear)
+ * @param cache use the binary cache file for loading
+ * @param ftab pointer set to the table
+ * @return Zero on success, otherwise the error of FuncTable::loadData
+ */
+int parfis::FuncTableRegistry::load(const std::string& fileName, int type, bool cache, 
+    std::shared_ptr<const FuncTable>& ftab)
+{
+    std::string content;
+    Global::readFile(fileName, content);
+    uint64_t sourceHash = Global::hash(content.data(), content.size());
+    std::string key = fileName + "|" + std::to_string(type) + "|" + 
+        std::to_string(sourceHash);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_tableMap.find(key);
+    if (it != m_tableMap.end()) {
+        ftab = it->second.lock();
+        if (ftab != nullptr)
+            return 0;
+    }
+    // Remove the tables that are freed
+    for (auto jt = m_tableMap.begin(); jt != m_tableMap.end();)
+        jt = jt->second.expired() ? m_tableMap.erase(jt) : std::next(jt);
+    std::shared_ptr<FuncTable> pft = std::make_shared<FuncTable>();
+    pft->type = type;
+    int retVal = pft->loadData(fileName, content, sourceHash, cache);
+    if (retVal == 0)
+        m_tableMap[key] = pft;
+    ftab = pft;
+    return retVal;
+}
+
+/// Number of tables used by the Parfis objects
+size_t parfis::FuncTableRegistry::size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t cnt = 0;
+    for (auto& keyTable : m_tableMap)
+        cnt += !keyTable.second.expired();
+    return cnt;
+}
+
+/**
+ * @brief Builds the alias table of one row with Vose's method
+ * @param row index of the row
+ * @param cumProb cumulative probabilities of the collisions (colCnt values)
+ */
+void parfis::ColAliasTable::buildRow(int row, const double* cumProb)
+{
+    Entry* pe = &entry[size_t(row)*colCnt];
+    std::vector<double> q(colCnt);
+    double total = 0;
+    for (int j = 0; j < colCnt; j++) {
+        q[j] = std::max(0.0, cumProb[j] - (j > 0 ? cumProb[j - 1] : 0.0));
+        total += q[j];
+    }
+    // Row without collisions is never used, every column is kept
+    if (total <= 0) {
+        for (int j = 0; j < colCnt; j++)
+            pe[j] = {1.0, uint32_t(j)};
+        return;
+    }
+    std::vector<int> small, large;
+    for (int j = 0; j < colCnt; j++) {
+        q[j] *= colCnt/total;
+        (q[j] < 1.0 ? small : large).push_back(j);
+    }
+    while (small.size() && large.size()) {
+        int s = small.back();
+        int l = large.back();
+        small.pop_back();
+        pe[s] = {q[s], uint32_t(l)};
+        q[l] -= 1.0 - q[s];
+        if (q[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Rest is one up to the rounding
+    for (int j : small)
+        pe[j] = {1.0, uint32_t(j)};
+    for (int j : large)
+        pe[j] = {1.0, uint32_t(j)};
+}
+
+/**
+ * @brief Builds the alias tables for the rows of the FuncTable
+ * @param ftab table with the cumulative collision probabilities in the columns
+ */
+void parfis::ColAliasTable::build(const FuncTable& ftab)
+{
+    rowCnt = ftab.xVec.size();
+    colCnt = ftab.yStride;
+    entry.resize(size_t(rowCnt)*colCnt);
+    for (int k = 0; k < rowCnt; k++)
+        buildRow(k, &ftab.yVec[size_t(k)*colCnt]);
+}
+
+/**
+ * @brief Builds the alias tables for the bins of the float table
+ * @param tab float table with the cumulative collision probabilities
+ */
+void parfis::ColAliasTable::build(const ColProbTable& tab)
+{
+    rowCnt = tab.binCnt;
+    colCnt = tab.colCnt;
+    entry.resize(size_t(rowCnt)*colCnt);
+    std::vector<double> cumProb(colCnt);
+    for (int b = 0; b < rowCnt; b++) {
+        for (int j = 0; j < colCnt; j++)
+            cumProb[j] = tab.prob[size_t(b)*tab.stride + j];
+        buildRow(b, cumProb.data());
+    }
+}
+
 /**
  * @brief Calculates the collision frequency.
  * 
@@ -372,24 +1034,24 @@ int parfis::GasCollision::calculateColFreq(const Specie & spec, const Gas& gas)
     double im = 1.0/spec.mass;
     double dt = spec.dt;
     // Probability data
-    freqFtab.nbins = xSecFtab.nbins;
+    freqFtab.nbins = xSecFtab->nbins;
     freqFtab.ranges.resize(freqFtab.nbins.size());
-    freqFtab.rowCnt = xSecFtab.rowCnt;
-    freqFtab.colCnt = xSecFtab.colCnt;
-    for(auto i = 0; i < xSecFtab.ranges.size(); i++) {
+    freqFtab.rowCnt = xSecFtab->rowCnt;
+    freqFtab.colCnt = xSecFtab->colCnt;
+    for(auto i = 0; i < xSecFtab->ranges.size(); i++) {
         freqFtab.ranges[i] = 
-            2.0*xSecFtab.ranges[i]*Const::eVJ*im*ivMaxSq;
+            2.0*xSecFtab->ranges[i]*Const::eVJ*im*ivMaxSq;
     }
-    freqFtab.xVec.resize(xSecFtab.xVec.size());
-    freqFtab.yVec.resize(xSecFtab.xVec.size());
-    for(auto i = 0; i < xSecFtab.xVec.size(); i++) {
-        freqFtab.xVec[i] = 2.0*xSecFtab.xVec[i]*Const::eVJ*im;
+    freqFtab.xVec.resize(xSecFtab->xVec.size());
+    freqFtab.yVec.resize(xSecFtab->xVec.size());
+    for(auto i = 0; i < xSecFtab->xVec.size(); i++) {
+        freqFtab.xVec[i] = 2.0*xSecFtab->xVec[i]*Const::eVJ*im;
         freqFtab.yVec[i] = 
-            gas.molDensity*Const::Na*xSecFtab.yVec[i]*1.0e-20*sqrt(freqFtab.xVec[i])*spec.dt;
+            gas.molDensity*Const::Na*xSecFtab->yVec[i]*1.0e-20*sqrt(freqFtab.xVec[i])*spec.dt;
         freqFtab.xVec[i] *= ivMaxSq;
     }
 
-    return 0;
+    return freqFtab.setIndex();
 }
 
 /**
@@ -401,6 +1063,7 @@ int parfis::SimData::calculateColProb(const CfgData * pCfgData)
 {
     // Calculate total collison data
     for (size_t i = 0; i < pCfgData->specieNameVec.size(); i++) {
+        specieVec[i].maxColProb = 0;
         if (specieVec[i].gasCollisionVecId.size() == 0) continue;
         gasCollisionProbVec.push_back({});
         FuncTable * pft = &gasCollisionProbVec.back();
@@ -438,7 +1101,12 @@ int parfis::SimData::calculateColProb(const CfgData * pCfgData)
         }
         // Last column is a total collision probability
         for (auto k = 0; k < pft->rowCnt; k++) {
-            pft->yVec[k*pft->colCnt + jt] = 1.0 - exp(-pft->yVec[k*pft->colCnt + jt]);
+            // expm1 keeps the precision of small probabilities
+            pft->yVec[k*pft->colCnt + jt] = -expm1(-pft->yVec[k*pft->colCnt + jt]);
+            // States are not faster than Specie::maxVel (x is velocity squared in maxVel^2)
+            if (pft->xVec[k] <= 1.0)
+                specieVec[i].maxColProb = 
+                    std::max(specieVec[i].maxColProb, pft->yVec[k*pft->colCnt + jt]);
         }
         for (size_t j = 0; j < pft->colCnt - 1; j++) {
             for (auto k = 0; k < pft->rowCnt; k++) {
@@ -446,6 +1114,84 @@ int parfis::SimData::calculateColProb(const CfgData * pCfgData)
                 pft->yVec[k*pft->colCnt + j] *= pft->yVec[k*pft->colCnt + jt];
             }
         }
+        pft->setIndex();
+    }
+    return 0;
+}
+
+/**
+ * @brief Resamples the collision probability tables to float tables
+ * @details Bins are doubled, starting from CfgData::colTableBins, until the error of 
+ * the table is below CfgData::colTableMaxError or the number of bins reaches 
+ * ColProbTable::maxBinCnt. Specie::maxColProb is increased if the float rounding 
+ * gives a larger total probability.
+ * @return Zero on success
+ */
+int parfis::SimData::resampleColProb(const CfgData * pCfgData)
+{
+    colProbTableVec.clear();
+    if (pCfgData->colTableBins <= 0)
+        return 0;
+    colProbTableVec.resize(gasCollisionProbVec.size());
+    for (size_t i = 0; i < gasCollisionProbVec.size(); i++) {
+        int bins = pCfgData->colTableBins;
+        while (colProbTableVec[i].resample(gasCollisionProbVec[i], bins) > 
+            pCfgData->colTableMaxError && bins < ColProbTable::maxBinCnt)
+            bins *= 2;
+    }
+    for (auto& spec : specieVec) {
+        if (spec.gasCollisionVecId.size() == 0) continue;
+        const ColProbTable& tab = colProbTableVec[spec.gasCollisionProbId];
+        for (int b = 0; b < tab.binCnt; b++)
+            spec.maxColProb = std::max(spec.maxColProb, 
+                double(tab.prob[b*tab.stride + tab.colCnt - 1]));
+    }
+    return 0;
+}
+
+/**
+ * @brief Builds the alias tables for selecting the collisions
+ * @details Tables are built from the float tables if they are used, otherwise from the 
+ * tables in gasCollisionProbVec, so the rows are the same as for the total probability.
+ * @return Zero on success
+ */
+int parfis::SimData::calculateColAlias()
+{
+    colAliasTableVec.resize(gasCollisionProbVec.size());
+    for (size_t i = 0; i < gasCollisionProbVec.size(); i++) {
+        if (colProbTableVec.size())
+            colAliasTableVec[i].build(colProbTableVec[i]);
+        else
+            colAliasTableVec[i].build(gasCollisionProbVec[i]);
+    }
+    return 0;
+}
+
+/**
+ * @brief Calculates the scattering data of the gas collisions
+ * @details Cosines of the deflection angles of all collisions of a specie are stored in 
+ * Specie::scatterCosVec, so the scattering of a batch gathers them from one table. The 
+ * gas particle is at rest, the collision without GasCollision::scatterAngle is isotropic 
+ * in the center of mass frame (deflections 0 and pi, uniform in cosine).
+ * @return Zero on success
+ */
+int parfis::SimData::calculateScatterTable()
+{
+    for (auto& spec : specieVec) {
+        spec.scatterCosVec.clear();
+        for (auto id : spec.gasCollisionVecId) {
+            GasCollision& gasCol = gasCollisionVec[id];
+            const Gas& gas = gasVec[gasCol.gasId];
+            if (gasCol.scatterAngle.size() < 2)
+                gasCol.scatterAngle = {0, Const::pi};
+            gasCol.scatterCosId = spec.scatterCosVec.size();
+            for (auto angle : gasCol.scatterAngle)
+                spec.scatterCosVec.push_back(cos(angle));
+            gasCol.massRatio = gas.amuMass/(spec.amuMass + gas.amuMass);
+            double reducedMass = spec.mass*gasCol.massRatio;
+            gasCol.lossSq = gasCol.type == 1 ? 
+                2.0*gasCol.threshold*Const::eVJ/reducedMass/(spec.maxVel*spec.maxVel) : 0;
+        }
     }
     return 0;
 }
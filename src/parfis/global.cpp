@@ -97,6 +97,91 @@ bool parfis::Global::fileExists(const std::string& fname)
     return f.good();
 }
 
+/**
+ * @brief Reads the whole file in binary mode
+ * @param fname file name
+ * @param content string for the file content
+ * @return Zero on success
+ */
+int parfis::Global::readFile(const std::string& fname, std::string& content)
+{
+    std::ifstream f(fname.c_str(), std::ios::binary);
+    if (!f.good())
+        return 1;
+    content.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    return 0;
+}
+
+/**
+ * @brief FNV-1a hash of the data
+ * @param data pointer to the data
+ * @param size number of bytes
+ * @param seed hash of the previous data, for hashing data in parts
+ * @return 64-bit hash
+ */
+uint64_t parfis::Global::hash(const void* data, size_t size, uint64_t seed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/**
+ * @brief Position of the point on the Morton (Z-order) curve
+ * @details Bits of the coordinates are interleaved, up to 21 bits of every coordinate.
+ * @return 64-bit key, points with a smaller key are before on the curve
+ */
+uint64_t parfis::Global::mortonKey(uint32_t x, uint32_t y, uint32_t z)
+{
+    uint64_t key = 0;
+    for (int b = 20; b >= 0; b--)
+        key = (key << 3) | (((x >> b) & 1) << 2) | (((y >> b) & 1) << 1) | ((z >> b) & 1);
+    return key;
+}
+
+/**
+ * @brief Position of the point on the Hilbert curve
+ * @details Coordinates are transformed to the transposed Hilbert index (J. Skilling, 
+ * Programming the Hilbert curve, AIP Conf. Proc. 707, 2004), and the bits of the 
+ * transposed index are interleaved. Points next to each other on the curve are 
+ * neighbours in space.
+ * @param bits number of bits of every coordinate (up to 21)
+ * @return 64-bit key, points with a smaller key are before on the curve
+ */
+uint64_t parfis::Global::hilbertKey(uint32_t x, uint32_t y, uint32_t z, int bits)
+{
+    uint32_t X[3] = {x, y, z};
+    uint32_t M = 1u << (bits - 1);
+    uint32_t t;
+    // Inverse undo
+    for (uint32_t Q = M; Q > 1; Q >>= 1) {
+        uint32_t P = Q - 1;
+        for (int i = 0; i < 3; i++) {
+            if (X[i] & Q) {
+                X[0] ^= P;
+            }
+            else {
+                t = (X[0] ^ X[i]) & P;
+                X[0] ^= t;
+                X[i] ^= t;
+            }
+        }
+    }
+    // Gray encode
+    X[1] ^= X[0];
+    X[2] ^= X[1];
+    t = 0;
+    for (uint32_t Q = M; Q > 1; Q >>= 1)
+        if (X[2] & Q) t ^= Q - 1;
+    for (int i = 0; i < 3; i++)
+        X[i] ^= t;
+    return mortonKey(X[0], X[1], X[2]);
+}
+
 /**
  * @brief Parses string and returns vector of elements
  * @param str string to be parsed of the form [a,b,c]
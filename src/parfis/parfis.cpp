@@ -10,6 +10,7 @@
 #include "parfis.h"
 #include "global.h"
 #include "version.h"
+#include "simd.h"
 #include "system.h"
 #include "config.h"
 
@@ -223,6 +224,44 @@ int parfis::Parfis::runCommandChain(const std::string& chainChainName)
     return retval;
 }
 
+/**
+ * @brief Runs the evolve command chain several times
+ * @details The commands of the chain are collected once, so a single step has no 
+ * lookup of the chain by name.
+ * @param stepCount number of evolve steps
+ * @param callbackPeriod the callback is called every callbackPeriod steps (zero for never)
+ * @param callback diagnostic function, evolving stops if it returns a nonzero value
+ * @return Zero on success, value returned by the failed command or the callback otherwise
+ */
+int parfis::Parfis::evolveSteps(uint64_t stepCount, uint64_t callbackPeriod, 
+    int (*callback)(uint32_t, uint64_t))
+{
+    int retval = 0;
+    auto it = m_cmdChainMap.find("evolve");
+    if (it == m_cmdChainMap.end()) {
+        LOG(m_logger, LogMask::Error, "evolve command chain is not defined\n");
+        return 1;
+    }
+    std::vector<std::function<int()>*> funcVec;
+    for (Command* pcom = it->second.get(); pcom != nullptr; pcom = pcom->getNext())
+        if (pcom->m_func)
+            funcVec.push_back(&pcom->m_func);
+    for (uint64_t step = 1; step <= stepCount; step++) {
+        for (auto pFunc : funcVec) {
+            retval = (*pFunc)();
+            if (retval != 0)
+                return retval;
+        }
+        m_simData.evolveCnt++;
+        if (callback != nullptr && callbackPeriod > 0 && step % callbackPeriod == 0) {
+            retval = callback(m_id, m_simData.evolveCnt);
+            if (retval != 0)
+                return retval;
+        }
+    }
+    return retval;
+}
+
 /**
  * @brief Configures the domain with a string and loads the CfgData
  * @param str with the configuration text of the type "key=value"
@@ -305,6 +344,7 @@ PARFIS_EXPORT const char* parfis::api::info()
     str += "\nparfis::version = " + std::string(Const::version);
     str += "\nparfis::buildConfig = " + std::string(Const::buildConfig);
     str += "\nparfis::gitTag = " + std::string(Const::gitTag);
+    str += "\nparfis::simd = " + std::string(PARFIS_SIMD_NAME);
     int pfSize = int(Parfis::s_parfisMap.size());
     str += "\nParfis object count = " + std::to_string(pfSize);
     str += "\nParfis object id = [";
@@ -655,6 +695,32 @@ PARFIS_EXPORT int parfis::api::runCommandChain(uint32_t id, const char* key)
     return Parfis::getParfis(id)->runCommandChain(key);
 }
 
+/**
+ * @brief Run the evolve command chain several times
+ * @param id of the Parfis object
+ * @param stepCount number of evolve steps
+ * @param callbackPeriod the callback is called every callbackPeriod steps (zero for never)
+ * @param callback diagnostic function called with the id and SimData::evolveCnt, 
+ * evolving stops if it returns a nonzero value
+ * @return Zero on success
+ */
+PARFIS_EXPORT int parfis::api::evolveSteps(uint32_t id, uint64_t stepCount, 
+    uint64_t callbackPeriod, EvolveCallback callback) 
+{
+    return Parfis::getParfis(id)->evolveSteps(stepCount, callbackPeriod, callback);
+}
+
+/**
+ * @brief Sets the collision counters (SimData::collisionCounter) to zero
+ * @param id of the Parfis object
+ * @return Zero on success
+ */
+PARFIS_EXPORT int parfis::api::resetCollisionCounter(uint32_t id)
+{
+    Parfis::getParfis(id)->m_simData.collisionCounter.clear();
+    return 0;
+}
+
 /**\n
  * @brief Expose the custom Global::to_string conversion from double
  * @param num double number to be converted to string
@@ -1,8 +1,14 @@
 #include <fstream>
 #include <random>
+#include <algorithm>
+#include <bitset>
+#include <limits>
+#include <cmath>
 #include "datastruct.h"
 #include "particle.h"
 #include "global.h"
+#include "simd.h"
+#include "random.h"
 
 /**
  * @brief Loads data into CfgData object 
@@ -15,6 +21,25 @@ int parfis::Particle::loadCfgData()
     std::string strTmp;
     std::vector<std::string> strVec;
     getParamToVector("specie", m_pCfgData->specieNameVec);
+    retVal = getParamToValue("stateLayout", m_pCfgData->stateLayout);
+    if (retVal) m_pCfgData->stateLayout = ParamDefault::stateLayout;
+    // Box geometry keeps the cell of every state, so it is pushed only with cell bins
+    if (m_pCfgData->geometry == 0 && m_pCfgData->stateLayout != StateLayout::Binned) {
+        LOG(*m_pLogger, LogMask::Warning, 
+            "stateLayout is set to 2 (StateLayout::Binned) for the box geometry\n");
+        m_pCfgData->stateLayout = StateLayout::Binned;
+    }
+    retVal = getParamToValue("rebinPeriod", m_pCfgData->rebinPeriod);
+    if (retVal || m_pCfgData->rebinPeriod < 1) m_pCfgData->rebinPeriod = ParamDefault::rebinPeriod;
+    retVal = getParamToValue("colTableBins", m_pCfgData->colTableBins);
+    if (retVal) m_pCfgData->colTableBins = ParamDefault::colTableBins;
+    retVal = getParamToValue("colTableMaxError", m_pCfgData->colTableMaxError);
+    if (retVal) m_pCfgData->colTableMaxError = ParamDefault::colTableMaxError;
+    retVal = getParamToValue("crossSectionCache", m_pCfgData->crossSectionCache);
+    if (retVal) m_pCfgData->crossSectionCache = ParamDefault::crossSectionCache;
+    retVal = getParamToValue("collisionCounterBins", m_pCfgData->collisionCounterBins);
+    if (retVal || m_pCfgData->collisionCounterBins < 1) 
+        m_pCfgData->collisionCounterBins = ParamDefault::collisionCounterBins;
     m_pCfgData->gasCollisionNameVec.clear();
     for (size_t i = 0; i < m_pCfgData->specieNameVec.size(); i++) {
         getParamToVector("specie." + m_pCfgData->specieNameVec[i] + ".gasCollision", strVec);
@@ -63,11 +88,15 @@ int parfis::Particle::loadSimData()
         retVal = getParamToValue("specie." + m_pCfgData->specieNameVec[i] + ".randomSeed", 
             m_pSimData->specieVec[i].randomSeed);
         if (retVal) m_pSimData->specieVec[i].randomSeed = ParamDefault::randomSeed;
-        m_pSimData->randomEngineVec.push_back(randEngine_t());
     }
 
     // Specie calculated data
     for (auto& spec: m_pSimData->specieVec) {
+        if (spec.timestepRatio < 1) {
+            LOG(*m_pLogger, LogMask::Warning, "timestepRatio of specie " + 
+                std::string(spec.name) + " is set to 1\n");
+            spec.timestepRatio = 1;
+        }
         spec.mass = spec.amuMass*Const::amuKg;
         spec.charge = spec.eCharge*Const::eCharge;
         spec.dt = double(spec.timestepRatio)*m_pCfgData->timestep;
@@ -82,6 +111,7 @@ int parfis::Particle::loadSimData()
             Const::multilineSeparator + 
             "mass [kg]: " + Global::to_string(spec.mass) + "\n" +
             "dt [s]: " + Global::to_string(spec.dt) + "\n" +
+            "pushed every " + std::to_string(spec.timestepRatio) + " evolve steps\n" +
             "max velocity [m/s]: " + Global::to_string(spec.maxVel) + "\n" +
             "max energy [eV]: " + Global::to_string(spec.maxEv) + "\n" +
             "charge/mass ratio [C/kg]: " + Global::to_string(spec.qm) + "\n" +
@@ -111,16 +141,25 @@ int parfis::Particle::loadSimData()
                         break;
                     }
                 }
+                // Threshold energy for the inelastic collision
+                retVal = getParamToValue("specie." + m_pCfgData->specieNameVec[i] + 
+                    ".gasCollision." + std::get<1>(specGasColl) + ".threshold", 
+                    m_pSimData->gasCollisionVec[j].threshold);
+                if (retVal) m_pSimData->gasCollisionVec[j].threshold = 0;
+                // Deflection angles, isotropic scattering if not given
+                getParamToVector("specie." + m_pCfgData->specieNameVec[i] + 
+                    ".gasCollision." + std::get<1>(specGasColl) + ".scatterAngle", 
+                    m_pSimData->gasCollisionVec[j].scatterAngle);
                 // Load data from cross section file
                 getParamToValue("specie." + m_pCfgData->specieNameVec[i] + ".gasCollision." + 
                     std::get<1>(specGasColl) + ".crossSectionFile", strTmp);
                 m_pCfgData->gasCollisionFileNameVec.push_back(strTmp);
                 m_pSimData->gasCollisionVec[j].fileName = 
                     m_pCfgData->gasCollisionFileNameVec[j].c_str();
-                // Cross section is nonlinear tabulated data
-                m_pSimData->gasCollisionVec[j].xSecFtab.type = 1;
-                m_pSimData->gasCollisionVec[j].xSecFtab.loadData(
-                    m_pCfgData->gasCollisionFileNameVec[j]);
+                // Cross section is nonlinear tabulated data, shared with other objects
+                FuncTableRegistry::load(m_pCfgData->gasCollisionFileNameVec[j], 1, 
+                    m_pCfgData->crossSectionCache != 0, 
+                    m_pSimData->gasCollisionVec[j].xSecFtab);
                 m_pSimData->gasCollisionVec[j].calculateColFreq(
                     m_pSimData->specieVec[i],
                     m_pSimData->gasVec[m_pSimData->gasCollisionVec[j].gasId]);
@@ -128,7 +167,31 @@ int parfis::Particle::loadSimData()
         }
     }
 
+    m_pSimData->collisionCounter.reset(m_pCfgData->collisionCounterBins, 
+        m_pSimData->specieVec.size(), m_pSimData->gasCollisionVec.size());
     m_pSimData->calculateColProb(m_pCfgData);
+    m_pSimData->resampleColProb(m_pCfgData);
+    m_pSimData->calculateColAlias();
+    m_pSimData->calculateScatterTable();
+    for (auto& spec: m_pSimData->specieVec) {
+        if (spec.gasCollisionVecId.size() == 0 || m_pSimData->colProbTableVec.size() == 0) 
+            continue;
+        const ColProbTable& tab = m_pSimData->colProbTableVec[spec.gasCollisionProbId];
+        std::string msg = "collision table of specie " + std::string(spec.name) + 
+            " resampled to " + std::to_string(tab.binCnt) + " float bins (" + 
+            std::to_string(tab.prob.size()*sizeof(float)) + " bytes), max error " + 
+            Global::to_string(tab.maxError) + "\n";
+        LOG(*m_pLogger, LogMask::Info, msg);
+        if (tab.maxError > m_pCfgData->colTableMaxError)
+            LOG(*m_pLogger, LogMask::Warning, "max error of the collision table of specie " + 
+                std::string(spec.name) + " is above colTableMaxError\n");
+    }
+
+    // Field coefficients are constant until the field changes (next loadSimData)
+    for (auto& spec: m_pSimData->specieVec) {
+        calculateDvUniformE(&spec);
+        calculateBorisCoef(&spec);
+    }
 
     // Set command for creating states
     Command *pcom;
@@ -142,7 +205,7 @@ int parfis::Particle::loadSimData()
             m_pCmdChainMap->at(cmdChainName)->m_cmdMap.end()) {
             pcom = m_pCmdChainMap->at(cmdChainName)->m_cmdMap[cmdName].get();
             // Do this differently for different geometries
-            if (m_pCfgData->geometry == 1) {
+            if (m_pCfgData->geometry == 0 || m_pCfgData->geometry == 1) {
                 // Instead of lambda expression here, we can also use 
                 // pcom->m_func = std::bind(&System::createCellsCylindrical, this);
                 pcom->m_func = [&]()->int { return createStates(); };
@@ -160,42 +223,87 @@ int parfis::Particle::loadSimData()
             m_pCmdChainMap->at(cmdChainName)->m_cmdMap.end()) {
             pcom = m_pCmdChainMap->at(cmdChainName)->m_cmdMap[cmdName].get();
             // Do this differently for different geometries
-            if (m_pCfgData->geometry == 1) {
-                pcom->m_func = [&]()->int { return pushStatesCylindrical(); };
-                pcom->m_funcName = "Particle::pushStatesCylindrical";
+            if (m_pCfgData->geometry == 0) {
+                pcom->m_func = [&]()->int { return pushStatesBox(); };
+                pcom->m_funcName = "Particle::pushStatesBox";
                 std::string msg = "pushStates command defined with " + pcom->m_funcName + "\n";
                 LOG(*m_pLogger, LogMask::Info, msg);
             }
-            if (m_pSimData->field.typeE == Vec3D<int>{0, 0, 0}) {
-                stepState = 
-                    [&](Specie* pSpec, State* pState) { return stepStateNoField(pSpec, pState); }; 
-                std::string msg = "stepStates function defined with Particle::stepStateNoField\n";
+            else if (m_pCfgData->geometry == 1 && m_pCfgData->stateLayout == StateLayout::SoA) {
+                pcom->m_func = [&]()->int { return pushStatesCylindricalSoA(); };
+                pcom->m_funcName = "Particle::pushStatesCylindricalSoA";
+                std::string msg = "pushStates command defined with " + pcom->m_funcName + "\n";
                 LOG(*m_pLogger, LogMask::Info, msg);
+                if (m_pCfgData->threads > 1)
+                    LOG(*m_pLogger, LogMask::Warning, 
+                        "states are pushed with one thread by " + pcom->m_funcName + "\n");
             }
-            if (m_pSimData->field.typeE == Vec3D<int>{0, 0, 1}) {
-                stepState = 
-                    [&](Specie* pSpec, State* pState) { return stepStateUniformEz(pSpec, pState); }; 
-                std::string msg = "stepStates function defined with Particle::stepStateNoField\n";
+            else if (m_pCfgData->geometry == 1 && m_pCfgData->stateLayout == StateLayout::Binned) {
+                pcom->m_func = [&]()->int { return pushStatesCylindricalBinned(); };
+                pcom->m_funcName = "Particle::pushStatesCylindricalBinned";
+                std::string msg = "pushStates command defined with " + pcom->m_funcName + "\n";
+                LOG(*m_pLogger, LogMask::Info, msg);
+            }
+            else if (m_pCfgData->geometry == 1) {
+                // Kernel instances for [fieldType][periodicZ]
+                typedef int (Particle::*PushFunc)();
+                static const PushFunc pushFuncTab[3][2] = {
+                    {&Particle::pushStatesCylindrical<FieldType::None, false>,
+                     &Particle::pushStatesCylindrical<FieldType::None, true>},
+                    {&Particle::pushStatesCylindrical<FieldType::UniformE, false>,
+                     &Particle::pushStatesCylindrical<FieldType::UniformE, true>},
+                    {&Particle::pushStatesCylindrical<FieldType::UniformEB, false>,
+                     &Particle::pushStatesCylindrical<FieldType::UniformEB, true>}};
+                static const char* fieldTypeName[3] = {"None", "UniformE", "UniformEB"};
+                int fieldType = getFieldType();
+                bool periodicZ = m_pCfgData->periodicBoundary.z != 0;
+                PushFunc pushFunc = pushFuncTab[fieldType][periodicZ];
+                pcom->m_func = [this, pushFunc]()->int { return (this->*pushFunc)(); };
+                pcom->m_funcName = std::string("Particle::pushStatesCylindrical<") + 
+                    fieldTypeName[fieldType] + (periodicZ ? ", periodic>" : ", wall>");
+                std::string msg = "pushStates command defined with " + pcom->m_funcName + "\n";
                 LOG(*m_pLogger, LogMask::Info, msg);
             }
         }
+        cmdName = "collideStates";
+        if (m_pCmdChainMap->at(cmdChainName)->m_cmdMap.find(cmdName) != 
+            m_pCmdChainMap->at(cmdChainName)->m_cmdMap.end()) {
+            pcom = m_pCmdChainMap->at(cmdChainName)->m_cmdMap[cmdName].get();
+            // Collisions don't depend on the geometry or the state layout
+            pcom->m_func = [&]()->int { return collideStates(); };
+            pcom->m_funcName = "Particle::collideStates";
+            std::string msg = "collideStates command defined with " + pcom->m_funcName + "\n";
+            LOG(*m_pLogger, LogMask::Info, msg);
+        }
     }
 
     return 0;
 }
 
+/**
+ * @brief Returns the type of field used for the push kernels
+ * @return FieldType::UniformEB if any direction has the magnetic field, 
+ * FieldType::UniformE if any direction has the electric field, otherwise FieldType::None
+ */
+int parfis::Particle::getFieldType()
+{
+    if (m_pSimData->field.typeB != Vec3D<int>{0, 0, 0})
+        return FieldType::UniformEB;
+    if (m_pSimData->field.typeE != Vec3D<int>{0, 0, 0})
+        return FieldType::UniformE;
+    return FieldType::None;
+}
+
 int parfis::Particle::createStates()
 {
-    // Initialize random engine
-    // Use random_device to generate a seed for Mersenne twister engine.
-    // Use Mersenne twister engine to generate pseudo-random numbers.
+    // Key of the random streams, random_device gives the key if there is no seed
     for (auto& spec : m_pSimData->specieVec) {
         if (spec.randomSeed == 0) {
             std::random_device rd;
-            m_pSimData->randomEngineVec[spec.id].seed(rd());
+            spec.randomKey = (uint64_t(rd()) << 32) ^ rd();
         }
         else {
-            m_pSimData->randomEngineVec[spec.id].seed(spec.randomSeed);
+            spec.randomKey = uint64_t(spec.randomSeed);
         }
     }
     
@@ -205,36 +313,88 @@ int parfis::Particle::createStates()
         stateSum += spec.statesPerCell;
 
     // Reserve space as if all states are used
-    m_pSimData->stateVec.reserve(stateSum * m_pSimData->cellVec.size());
-    m_pSimData->stateFlagVec.reserve(stateSum * m_pSimData->cellVec.size());
+    if (m_pCfgData->stateLayout == StateLayout::SoA) {
+        m_pSimData->stateSoA.reserve(stateSum * m_pSimData->cellVec.size());
+    }
+    else if (m_pCfgData->stateLayout == StateLayout::Binned) {
+        m_pSimData->stateSoA.reserve(stateSum * m_pSimData->cellVec.size(), true);
+    }
+    else {
+        m_pSimData->stateVec.reserve(stateSum * m_pSimData->cellVec.size());
+    }
     std::string msg = "reserved " + std::to_string(stateSum * m_pSimData->cellVec.size()) + 
         " states for all species" + "\n";
     LOG(*m_pLogger, LogMask::Memory, msg);
 
-    // Resize headIdVec
-    m_pSimData->headIdVec.resize(
-        m_pSimData->specieVec.size()*m_pSimData->cellVec.size(), Const::noStateId);
-    msg = "created " + std::to_string(m_pSimData->headIdVec.size()) + " head pointers\n";
+    if (m_pCfgData->stateLayout == StateLayout::Binned) {
+        // Bins replace the head pointers, one more offset marks the end of the last bin
+        m_pSimData->binOffsetVec.resize(
+            m_pSimData->specieVec.size()*m_pSimData->cellVec.size() + 1, 0);
+        msg = "created " + std::to_string(m_pSimData->binOffsetVec.size()) + " bin offsets\n";
+    }
+    else {
+        // Resize headIdVec
+        m_pSimData->headIdVec.resize(
+            m_pSimData->specieVec.size()*m_pSimData->cellVec.size(), Const::noStateId);
+        msg = "created " + std::to_string(m_pSimData->headIdVec.size()) + " head pointers\n";
+    }
     LOG(*m_pLogger, LogMask::Memory, msg);    
     for (auto& spec : m_pSimData->specieVec) {
         spec.headIdOffset = spec.id*m_pSimData->cellVec.size();
         createStatesOfSpecie(spec);
     }
+    if (m_pCfgData->stateLayout == StateLayout::Binned)
+        m_pSimData->binOffsetVec.back() = m_pSimData->stateSoA.size();
+    createSlabs();
+    return 0;
+}
+
+/**
+ * @brief Splits cells in z-slabs, one slab for every thread
+ * @details Slabs are contiguous ranges of the cell z index with (almost) the same number 
+ * of z layers. The number of slabs is CfgData::threads, but not more than the number of 
+ * cells in z. Since a state moves less than a cell in one timestep, states migrate only 
+ * to the neighbour slabs.
+ * @return Zero on success
+ */
+int parfis::Particle::createSlabs()
+{
+    int slabCount = std::max(1, std::min(m_pCfgData->threads, m_pCfgData->cellCount.z));
+    m_slabIdVec.resize(m_pCfgData->cellCount.z);
+    for (int z = 0; z < m_pCfgData->cellCount.z; z++)
+        m_slabIdVec[z] = int(int64_t(z)*slabCount/m_pCfgData->cellCount.z);
+    m_slabCellIdAVec.assign(slabCount, std::vector<cellId_t>());
+    m_slabCellIdBVec.assign(slabCount, std::vector<cellId_t>());
+    for (cellId_t cellId : m_pSimData->cellIdAVec)
+        m_slabCellIdAVec[m_slabIdVec[m_pSimData->cellVec[cellId].pos.z]].push_back(cellId);
+    for (cellId_t cellId : m_pSimData->cellIdBVec)
+        m_slabCellIdBVec[m_slabIdVec[m_pSimData->cellVec[cellId].pos.z]].push_back(cellId);
+    m_migrationVec.assign(slabCount*slabCount, std::vector<std::pair<stateId_t, size_t>>());
+    m_cellPushVec.assign(m_pSimData->cellVec.size(), 0);
+    m_pushCnt = 0;
+    m_crossingVec.assign(slabCount, std::vector<CellCrossing>());
+    m_boundStateVec.assign(slabCount, std::vector<stateId_t>());
+    m_wallBatchVec.assign(slabCount, WallBatch());
+    m_collisionBatchVec.assign(slabCount, CollisionBatch());
+    m_collisionCounterVec.assign(slabCount, CollisionCounter());
+    if (m_pThreadPool == nullptr || m_pThreadPool->size() != slabCount)
+        m_pThreadPool = std::make_shared<ThreadPool>(slabCount);
+    std::string msg = "created " + std::to_string(slabCount) + " z-slabs for pushing states\n";
+    LOG(*m_pLogger, LogMask::Info, msg);
     return 0;
 }
 
 int parfis::Particle::createStatesOfSpecie(Specie& spec)
 {
-    // Get the random engine
-    randEngine_t &engine = m_pSimData->randomEngineVec[spec.id];
-    // The range is[inclusive, inclusive].
-    std::uniform_real_distribution<state_t> dist{ 0.0, 1.0 };
     State state;
-    State* pState;
     Cell* pCell;
-    stateId_t headId;
+    stateId_t headId, stateId;
+    bool soa = m_pCfgData->stateLayout == StateLayout::SoA;
+    bool binned = m_pCfgData->stateLayout == StateLayout::Binned;
     // Set count to zero
     spec.stateCount = 0;
+    spec.stateIdOffset = (soa || binned) ? 
+        m_pSimData->stateSoA.size() : m_pSimData->stateVec.size();
     double uCellSizeX = m_pCfgData->cellSize.x;
     double uCellSizeY = m_pCfgData->cellSize.y;
     // Center of the geometry
@@ -246,17 +406,22 @@ int parfis::Particle::createStatesOfSpecie(Specie& spec)
     double rx, ry;
     std::string msg;
     for (cellId_t ci = 0; ci < m_pSimData->cellVec.size(); ci++) {
+        // States are created cell by cell, so they are already sorted in bins
+        if (binned)
+            m_pSimData->binOffsetVec[spec.headIdOffset + ci] = m_pSimData->stateSoA.size();
+        // Every cell has its own random stream
+        RandomStream rnd(spec.randomKey, spec.id, ci, 0, RandomStreamId::CreateStates);
         for (stateId_t si = 0; si < spec.statesPerCell; si++) {
-            state.pos.x = dist(engine);
-            state.pos.y = dist(engine);
-            state.pos.z = dist(engine);
+            state.pos.x = rnd.uniform();
+            state.pos.y = rnd.uniform();
+            state.pos.z = rnd.uniform();
             // 0: uniform distribution
             if (spec.velInitDist == 0) {
-                state.vel.x = (spec.velInitDistMax.x - spec.velInitDistMin.x)*dist(engine) + 
+                state.vel.x = (spec.velInitDistMax.x - spec.velInitDistMin.x)*rnd.uniform() + 
                     spec.velInitDistMin.x;
-                state.vel.y = (spec.velInitDistMax.y - spec.velInitDistMin.y)*dist(engine) + 
+                state.vel.y = (spec.velInitDistMax.y - spec.velInitDistMin.y)*rnd.uniform() + 
                     spec.velInitDistMin.y;
-                state.vel.z = (spec.velInitDistMax.z - spec.velInitDistMin.z)*dist(engine) + 
+                state.vel.z = (spec.velInitDistMax.z - spec.velInitDistMin.z)*rnd.uniform() + 
                     spec.velInitDistMin.z;
             }
 
@@ -270,20 +435,31 @@ int parfis::Particle::createStatesOfSpecie(Specie& spec)
                 if (rx * rx + ry * ry > radiusSquared)
                     continue;
             }
+            if (binned) {
+                m_pSimData->stateSoA.push_back(state, ci);
+                spec.stateCount++;
+                continue;
+            }
             // Add states in list
-            m_pSimData->stateVec.push_back(state);
-            m_pSimData->stateFlagVec.push_back(StateFlag::None);
-            pState = &m_pSimData->stateVec.back();
-            pState->next = Const::noStateId;
-            pState->prev = Const::noStateId;
             headId = m_pSimData->headIdVec[spec.headIdOffset + ci];
-            // If it is not first state in the cell
-            if (headId != Const::noStateId) {
-                m_pSimData->stateVec[headId].prev = m_pSimData->stateVec.size() - 1;
-                pState->next = headId;
+            state.prev = Const::noStateId;
+            state.next = headId;
+            if (soa) {
+                stateId = m_pSimData->stateSoA.size();
+                m_pSimData->stateSoA.push_back(state);
+                // If it is not first state in the cell
+                if (headId != Const::noStateId)
+                    m_pSimData->stateSoA.prev[headId] = stateId;
+            }
+            else {
+                stateId = m_pSimData->stateVec.size();
+                m_pSimData->stateVec.push_back(state);
+                // If it is not first state in the cell
+                if (headId != Const::noStateId)
+                    m_pSimData->stateVec[headId].prev = stateId;
             }
             // Set head pointer
-            m_pSimData->headIdVec[spec.headIdOffset + ci] = m_pSimData->stateVec.size() - 1;
+            m_pSimData->headIdVec[spec.headIdOffset + ci] = stateId;
             spec.stateCount++;
         }
     }
@@ -296,15 +472,244 @@ int parfis::Particle::createStatesOfSpecie(Specie& spec)
 }
 
 
+/**
+ * @brief Push states of all species, for cylindrical geometry and StateLayout::AoS
+ * @details The kernel is instantiated for every field type (FieldType) and z-boundary 
+ * condition, and the instance is chosen once in Particle::loadSimData, so the inner 
+ * loops have no indirect calls and no branches on the configuration.
+ * @tparam fieldType one of FieldType values
+ * @tparam periodicZ true for the periodic z-boundary, false for the wall
+ * @return Zero on success
+ */
+template<int fieldType, bool periodicZ>
 int parfis::Particle::pushStatesCylindrical()
 {
     Specie *pSpec;
+    // Center of the geometry
+    Vec3D<double> geoCenter = {
+        0.5 * m_pCfgData->cellCount.x, 
+        0.5 * m_pCfgData->cellCount.y,
+        0.5 * m_pCfgData->cellCount.z};
+    int slabCount = m_pThreadPool->size();
+    for (size_t specId = 0; specId < m_pSimData->specieVec.size(); specId++) {
+        pSpec = &m_pSimData->specieVec[specId];
+        // Specie is pushed every timestepRatio evolve steps
+        if (m_pSimData->evolveCnt % pSpec->timestepRatio != 0)
+            continue;
+        m_pushCnt++;
+        // Every thread pushes states from its own slab
+        m_pThreadPool->run([&](int slabId) {
+            WallBatch& batch = m_wallBatchVec[slabId];
+            batch.clear();
+            // Go through cells that lie inside the geo
+            for (cellId_t cellId : m_slabCellIdAVec[slabId])
+                pushCellStates<fieldType, periodicZ, false>(pSpec, cellId, geoCenter, 
+                    batch, slabId);
+            // Go through bound cells, states that left the cylinder are reflected from 
+            // the wall in a batch and cross cells after it
+            for (cellId_t cellId : m_slabCellIdBVec[slabId])
+                pushCellStates<fieldType, periodicZ, true>(pSpec, cellId, geoCenter, 
+                    batch, slabId);
+            reflectCylindricalBatch(batch, geoCenter.x);
+            scatterWallBatch(batch, geoCenter);
+            for (size_t i = 0; i < batch.size(); i++)
+                crossCell<periodicZ, true>(pSpec, batch.stateId[i], batch.cellId[i], slabId);
+        });
+        // Link states that moved to another cell
+        m_pThreadPool->run([&](int slabId) {
+            for (int srcId = 0; srcId < slabCount; srcId++) {
+                auto& migration = m_migrationVec[srcId*slabCount + slabId];
+                for (auto& stateIdPos : migration)
+                    linkState(stateIdPos.first, stateIdPos.second);
+                migration.clear();
+            }
+        });
+    }
+    return 0;
+}
+
+/**
+ * @brief Push states of a specie that are in one cell
+ * @details States of bound cells that left the cylinder are added to the batch, and 
+ * cross cells after Particle::reflectCylindricalBatch. Other states cross cells in the 
+ * same pass, so every state is visited once.
+ * @tparam fieldType one of FieldType values
+ * @tparam periodicZ true for the periodic z-boundary, false for the wall
+ * @tparam boundCell true for cells from cellIdBVec, where boundaries are checked
+ * @param pSpec pointer to the specie
+ * @param cellId id of the cell
+ * @param geoCenter center of the geometry
+ * @param batch states that left the cylinder are added with the position before the step
+ * @param slabId z-slab of the cell, states moving to other cells are put in m_migrationVec
+ */
+template<int fieldType, bool periodicZ, bool boundCell>
+void parfis::Particle::pushCellStates(Specie* pSpec, cellId_t cellId, 
+    Vec3D<double>& geoCenter, WallBatch& batch, int slabId)
+{
     State *pState;
+    stateId_t nextId;
+    double rx, ry;
+    Cell *pCell = &m_pSimData->cellVec[cellId];
+    m_cellPushVec[cellId] = m_pushCnt;
+    // Get the head state
+    stateId_t stateId = m_pSimData->headIdVec[pSpec->headIdOffset + cellId];
+    // Go through all states of the specie in one cell
+    while (stateId != Const::noStateId) {
+        pState = &m_pSimData->stateVec[stateId];
+        nextId = pState->next;
+        stepState<fieldType>(pSpec, *pState);
+        if constexpr (boundCell) {
+            rx = pState->pos.x + pCell->pos.x - geoCenter.x;
+            ry = pState->pos.y + pCell->pos.y - geoCenter.y;
+            if (rx * rx + ry * ry > geoCenter.x*geoCenter.x) {
+                batch.push_back(stateId, cellId, rx - pState->vel.x, ry - pState->vel.y, 
+                    pState->vel.x, pState->vel.y);
+                stateId = nextId;
+                continue;
+            }
+        }
+        crossCell<periodicZ, boundCell>(pSpec, stateId, cellId, slabId);
+        stateId = nextId;
+    }
+}
+
+/**
+ * @brief Moves a pushed state to the cell it traversed to
+ * @details The state is unlinked from its cell. If the new cell is in the same slab and 
+ * is already pushed (m_cellPushVec) the state is linked to it at once, otherwise it is 
+ * queued in m_migrationVec and linked after the push (by the thread of the new slab), 
+ * so it is not visited twice.
+ * @tparam periodicZ true for the periodic z-boundary, false for the wall
+ * @tparam boundCell true for cells from cellIdBVec, where the z-boundary is checked
+ * @param pSpec pointer to the specie
+ * @param stateId id of the state
+ * @param cellId id of the cell of the state
+ * @param slabId z-slab of the cell
+ */
+template<bool periodicZ, bool boundCell>
+inline void parfis::Particle::crossCell(Specie* pSpec, stateId_t stateId, cellId_t cellId, 
+    int slabId)
+{
+    State& state = m_pSimData->stateVec[stateId];
+    const Cell& cell = m_pSimData->cellVec[cellId];
+    Cell newCell;
+    newCell.pos = cell.pos;
+    traverseCell(state, newCell);
+    if constexpr (boundCell)
+        boundZ<periodicZ>(state, newCell);
+    // If cell is traversed
+    if (newCell.pos != cell.pos) {
+        // newCellId must exist (no Global::noCellId, no id that doesn't exist) 
+        // so if the following line segfaults something has been faulty coded
+        cellId_t newCellId = m_pSimData->cellIndex.cellId(newCell.pos);
+        int newSlabId = m_slabIdVec[newCell.pos.z];
+        unlinkState(state, pSpec->headIdOffset + cellId);
+        if (newSlabId == slabId && m_cellPushVec[newCellId] == m_pushCnt)
+            linkState(stateId, pSpec->headIdOffset + newCellId);
+        else
+            m_migrationVec[slabId*m_slabCellIdAVec.size() + newSlabId].push_back(
+                {stateId, pSpec->headIdOffset + newCellId});
+    }
+}
+
+/**
+ * @brief Advances velocity and position of a state for one timestep
+ * @details For FieldType::UniformEB the velocity is advanced with the Boris scheme, 
+ * half of the electric impulse, rotation around the magnetic field and the other half 
+ * of the electric impulse. The rotation is done in units of cellSize.x so it is valid 
+ * for cells that are not cubes.
+ * @tparam fieldType one of FieldType values
+ * @param pSpec pointer to the specie
+ * @param state state to advance
+ */
+template<int fieldType>
+inline void parfis::Particle::stepState(const Specie *pSpec, State& state)
+{
+    if constexpr (fieldType == FieldType::UniformE) {
+        state.vel.x += pSpec->dvUniformE.x;
+        state.vel.y += pSpec->dvUniformE.y;
+        state.vel.z += pSpec->dvUniformE.z;
+    }
+    else if constexpr (fieldType == FieldType::UniformEB) {
+        const Vec3D<double>& t = pSpec->borisT;
+        const Vec3D<double>& cs = pSpec->cellScale;
+        // Half of the electric impulse, in scaled units
+        double vx = (state.vel.x + 0.5*pSpec->dvUniformE.x)*cs.x;
+        double vy = (state.vel.y + 0.5*pSpec->dvUniformE.y)*cs.y;
+        double vz = (state.vel.z + 0.5*pSpec->dvUniformE.z)*cs.z;
+        // v' = v + v x t
+        double px = vx + vy*t.z - vz*t.y;
+        double py = vy + vz*t.x - vx*t.z;
+        double pz = vz + vx*t.y - vy*t.x;
+        // v = v + v' x s, where s = borisS*t
+        vx += pSpec->borisS*(py*t.z - pz*t.y);
+        vy += pSpec->borisS*(pz*t.x - px*t.z);
+        vz += pSpec->borisS*(px*t.y - py*t.x);
+        state.vel.x = vx/cs.x + 0.5*pSpec->dvUniformE.x;
+        state.vel.y = vy/cs.y + 0.5*pSpec->dvUniformE.y;
+        state.vel.z = vz/cs.z + 0.5*pSpec->dvUniformE.z;
+    }
+    state.pos.x += state.vel.x;
+    state.pos.y += state.vel.y;
+    state.pos.z += state.vel.z;
+}
+
+/**
+ * @brief Applies the z-boundary condition after the state traversed cells
+ * @tparam periodicZ true for the periodic z-boundary, false for the wall
+ * @param state the state
+ * @param newCell cell of the state after traversing
+ */
+template<bool periodicZ>
+inline void parfis::Particle::boundZ(State& state, Cell& newCell)
+{
+    if (newCell.pos.z == m_pCfgData->cellCount.z) {
+        // Periodic boundary - torus like geometry
+        if constexpr (periodicZ) {
+            newCell.pos.z = 0;
+        }
+        // Reflection from z-bound
+        else {
+            state.pos.z  = 1.0 - state.pos.z;
+            state.vel.z *= -1.0;
+            newCell.pos.z = m_pCfgData->cellCount.z - 1;
+        }
+    }
+    else if (newCell.pos.z == 0xFFFF) {
+        // Periodic boundary - torus like geometry
+        if constexpr (periodicZ) {
+            newCell.pos.z = m_pCfgData->cellCount.z - 1;
+        }
+        // Reflection from z-bound
+        else {
+            state.pos.z = 1.0 - state.pos.z;
+            state.vel.z *= -1.0;
+            newCell.pos.z = 0;
+        }
+    }
+}
+
+/**
+ * @brief Push states stored as a structure of arrays (StateLayout::SoA)
+ * @details The push is done in two passes. First, the positions and velocities of all 
+ * states of a specie are advanced with the vectorized kernel stepStatesSoA, which 
+ * streams through the contiguous arrays of the specie. In the second pass the cells are 
+ * traversed and the boundary conditions and cell crossings are resolved. States that 
+ * cross to another cell are queued and linked to the new cell after the pass, so every 
+ * state is visited once.
+ * @return Zero on success
+ */
+int parfis::Particle::pushStatesCylindricalSoA()
+{
+    StateSoA& soa = m_pSimData->stateSoA;
+    std::vector<std::pair<stateId_t, size_t>>& migration = m_migrationVec[0];
+    WallBatch& batch = m_wallBatchVec[0];
+    Specie *pSpec;
+    State state;
     Cell *pCell;
     Cell newCell;
-    cellId_t cellId, newCellId;
-    stateId_t stateId;
-    uint16_t mark;
+    cellId_t newCellId;
+    stateId_t stateId, nextId;
     // Center of the geometry
     Vec3D<double> geoCenter = {
         0.5 * m_pCfgData->cellCount.x, 
@@ -312,137 +717,800 @@ int parfis::Particle::pushStatesCylindrical()
         0.5 * m_pCfgData->cellCount.z};
     double rx, ry;
     double radiusSquared = geoCenter.x*geoCenter.x; 
-    double invRadius = 1.0 / geoCenter.x;
-    // Reset pushed state vector
-    std::fill(m_pSimData->stateFlagVec.begin(), m_pSimData->stateFlagVec.end(), 0);
     for (size_t specId = 0; specId < m_pSimData->specieVec.size(); specId++) {
-        // Define timestep and 1/timestep for specie
         pSpec = &m_pSimData->specieVec[specId];
-        // velocity change in computational units:
-        // DV = (q*E*dt^2)/(m*CellLength)
-        pSpec->dvUniformE.x = m_pSimData->field.strengthE.x*(pSpec->charge*Const::eCharge * 
-            pSpec->timestepRatio * pSpec->timestepRatio * pSpec->dt * pSpec->dt)/
-            (pSpec->amuMass*Const::amuKg * m_pCfgData->cellSize.x);
-
-        pSpec->dvUniformE.y = m_pSimData->field.strengthE.y*(pSpec->charge*Const::eCharge * 
-            pSpec->timestepRatio * pSpec->timestepRatio * pSpec->dt * pSpec->dt)/
-            (pSpec->amuMass*Const::amuKg * m_pCfgData->cellSize.y);
-
-        pSpec->dvUniformE.z = m_pSimData->field.strengthE.z*(pSpec->charge*Const::eCharge * 
-            pSpec->timestepRatio * pSpec->timestepRatio * pSpec->dt * pSpec->dt)/
-            (pSpec->amuMass*Const::amuKg * m_pCfgData->cellSize.z);
+        // Specie is pushed every timestepRatio evolve steps
+        if (m_pSimData->evolveCnt % pSpec->timestepRatio != 0)
+            continue;
+        stepStatesSoA(pSpec, pSpec->stateIdOffset, pSpec->stateIdOffset + pSpec->stateCount);
         // Go through cells that lie inside the geo
         for (cellId_t cellId : m_pSimData->cellIdAVec) {
-            // New position for traversing cells
             pCell = &m_pSimData->cellVec[cellId];
-            // Get the head state
             stateId = m_pSimData->headIdVec[pSpec->headIdOffset + cellId];
-            // Go through all states of the specie in one cell
             while (stateId != Const::noStateId) {
-                // If it was pushed previously - just continue
-                if (m_pSimData->stateFlagVec[stateId] == StateFlag::PushedState) {
-                    stateId = m_pSimData->stateVec[stateId].next;
-                    continue;
-                }
-                pState = &m_pSimData->stateVec[stateId];
-                stepState(pSpec, pState);
+                nextId = soa.next[stateId];
+                state.pos = {soa.posX[stateId], soa.posY[stateId], soa.posZ[stateId]};
                 newCell.pos = pCell->pos;
-                traverseCell(*pState, newCell);
-                m_pSimData->stateFlagVec[stateId] = StateFlag::PushedState;
-                stateId = m_pSimData->stateVec[stateId].next;
-                // If cell is traversed
+                traverseCell(state, newCell);
                 if (newCell.pos != pCell->pos) {
-                    // newCellId must exist (no Global::noCellId, no id that doesn't exist) 
-                    // so if the following line segfaults something has been faulty coded
-                    newCellId = m_pSimData->cellIdVec[m_pCfgData->getAbsoluteCellId(newCell.pos)];
-                    // Set states linked list for the old cell and the new cell
-                    setNewCell(*pState,
-                        pSpec->headIdOffset + cellId, 
-                        pSpec->headIdOffset + newCellId);
+                    soa.posX[stateId] = state.pos.x;
+                    soa.posY[stateId] = state.pos.y;
+                    soa.posZ[stateId] = state.pos.z;
+                    newCellId = m_pSimData->cellIndex.cellId(newCell.pos);
+                    unlinkStateSoA(stateId, pSpec->headIdOffset + cellId);
+                    migration.push_back({stateId, pSpec->headIdOffset + newCellId});
                 }
+                stateId = nextId;
             }
         }
-        // Go through bound cells (check boundary crossing every time)
+        // Go through bound cells, states that left the cylinder are reflected from the 
+        // wall in a batch before they cross cells
+        batch.clear();
+        for (cellId_t cellId : m_pSimData->cellIdBVec) {
+            pCell = &m_pSimData->cellVec[cellId];
+            stateId = m_pSimData->headIdVec[pSpec->headIdOffset + cellId];
+            for (; stateId != Const::noStateId; stateId = soa.next[stateId]) {
+                rx = soa.posX[stateId] + pCell->pos.x - geoCenter.x;
+                ry = soa.posY[stateId] + pCell->pos.y - geoCenter.y;
+                if (rx * rx + ry * ry > radiusSquared)
+                    batch.push_back(stateId, cellId, rx - soa.velX[stateId], 
+                        ry - soa.velY[stateId], soa.velX[stateId], soa.velY[stateId]);
+            }
+        }
+        reflectCylindricalBatch(batch, geoCenter.x);
+        scatterWallBatch(batch, geoCenter);
         for (cellId_t cellId : m_pSimData->cellIdBVec) {
-            // New position for traversing cells
             pCell = &m_pSimData->cellVec[cellId];
-            // Get the head state
             stateId = m_pSimData->headIdVec[pSpec->headIdOffset + cellId];
-            // Go through all states of the specie in one cell
             while (stateId != Const::noStateId) {
-                // If it was pushed previously - just continue
-                if (m_pSimData->stateFlagVec[stateId] == StateFlag::PushedState) {
-                    stateId = m_pSimData->stateVec[stateId].next;
-                    continue;
-                }
-                pState = &m_pSimData->stateVec[stateId];
-                stepState(pSpec, pState);                
-                rx = pState->pos.x + pCell->pos.x - geoCenter.x;
-                ry = pState->pos.y + pCell->pos.y - geoCenter.y;
-                if (rx * rx + ry * ry > radiusSquared) {
-                    // Return particle to position before the reflection
-                    pState->pos.x -= pState->vel.x;
-                    pState->pos.y -= pState->vel.y;
-                    // Do the reflection from walls
-                    reflectCylindrical(*pState, *pCell, geoCenter, invRadius);
-                }
+                nextId = soa.next[stateId];
+                state = soa.getState(stateId);
                 newCell.pos = pCell->pos;
-                traverseCell(*pState, newCell);
+                traverseCell(state, newCell);
                 // Now check the z-boundary
-                if (newCell.pos.z == m_pCfgData->cellCount.z) {
-                    // Periodic boundary - torus like geometry
-                    if (m_pCfgData->periodicBoundary.z) {
-                        newCell.pos.z = 0;
-                    }
-                    // Reflection from z-bound
-                    else {
-                        pState->pos.z  = 1.0 - pState->pos.z;
-                        pState->vel.z *= -1.0;
-                        newCell.pos.z = m_pCfgData->cellCount.z - 1;
-                    }
-                }
-                else if (newCell.pos.z == 0xFFFF) {
-                    // Periodic boundary - torus like geometry
-                    if (m_pCfgData->periodicBoundary.z) {
-                        newCell.pos.z = m_pCfgData->cellCount.z - 1;
-                    }
-                    // Reflection from z-bound
-                    else {
-                        pState->pos.z = 1.0 - pState->pos.z;
-                        pState->vel.z *= -1.0;
-                        newCell.pos.z = 0;
-                    }
-                }
-                m_pSimData->stateFlagVec[stateId] = StateFlag::PushedState;
-                stateId = m_pSimData->stateVec[stateId].next;
+                if (m_pCfgData->periodicBoundary.z)
+                    boundZ<true>(state, newCell);
+                else
+                    boundZ<false>(state, newCell);
+                soa.setState(stateId, state);
                 if (newCell.pos != pCell->pos) {
-                    // newCellId must exist (no Global::noCellId, no id that doesn't exist) 
-                    // so if the following line segfaults something has been faulty coded
-                    newCellId = m_pSimData->cellIdVec[m_pCfgData->getAbsoluteCellId(newCell.pos)];
-                    // Set states linked list for the old cell and the new cell
-                    setNewCell(*pState,
-                        pSpec->headIdOffset + cellId, 
-                        pSpec->headIdOffset + newCellId);
+                    newCellId = m_pSimData->cellIndex.cellId(newCell.pos);
+                    unlinkStateSoA(stateId, pSpec->headIdOffset + cellId);
+                    migration.push_back({stateId, pSpec->headIdOffset + newCellId});
                 }
+                stateId = nextId;
             }
         }
+        // Link states that moved to another cell
+        for (auto& stateIdPos : migration)
+            linkStateSoA(stateIdPos.first, stateIdPos.second);
+        migration.clear();
     }
     return 0;
 }
 
-void parfis::Particle::stepStateNoField(Specie *pSpec, State *pState)
+/**
+ * @brief Push states sorted in cell bins (StateLayout::Binned)
+ * @details Positions and velocities are advanced with stepStatesSoA, after which the bins 
+ * of cells are traversed linearly. A state that left the cell of its bin since the last 
+ * sorting keeps its cell in StateSoA::cellId and is handled with the boundary checks, 
+ * same as states from the B cells. States are sorted again every CfgData::rebinPeriod 
+ * evolve steps.
+ * @return Zero on success
+ */
+int parfis::Particle::pushStatesCylindricalBinned()
 {
-    pState->pos.x += pState->vel.x;
-    pState->pos.y += pState->vel.y;
-    pState->pos.z += pState->vel.z;
+    if (m_pSimData->evolveCnt > 0 && m_pSimData->evolveCnt % m_pCfgData->rebinPeriod == 0)
+        sortStatesBinned();
+    StateSoA& soa = m_pSimData->stateSoA;
+    Specie *pSpec;
+    // Center of the geometry
+    Vec3D<double> geoCenter = {
+        0.5 * m_pCfgData->cellCount.x, 
+        0.5 * m_pCfgData->cellCount.y,
+        0.5 * m_pCfgData->cellCount.z};
+    int threadCount = m_pThreadPool->size();
+    for (size_t specId = 0; specId < m_pSimData->specieVec.size(); specId++) {
+        pSpec = &m_pSimData->specieVec[specId];
+        // Specie is pushed every timestepRatio evolve steps
+        if (m_pSimData->evolveCnt % pSpec->timestepRatio != 0)
+            continue;
+        // Split the states of the specie in chunks aligned to the cache line
+        size_t chunk = (pSpec->stateCount + threadCount - 1) / threadCount;
+        chunk = (chunk + 15) / 16 * 16;
+        m_pThreadPool->run([&](int threadId) {
+            stateId_t first = pSpec->stateIdOffset + 
+                std::min(size_t(pSpec->stateCount), threadId*chunk);
+            stateId_t last = pSpec->stateIdOffset + 
+                std::min(size_t(pSpec->stateCount), (threadId + 1)*chunk);
+            stepStatesSoA(pSpec, first, last);
+        });
+        // Bins of every slab are traversed by the thread of the slab
+        m_pThreadPool->run([&](int slabId) {
+            Cell newCell;
+            size_t bin;
+            double rx, ry;
+            std::vector<CellCrossing>& crossingVec = m_crossingVec[slabId];
+            std::vector<stateId_t>& boundStateVec = m_boundStateVec[slabId];
+            WallBatch& batch = m_wallBatchVec[slabId];
+            boundStateVec.clear();
+            // Go through cells that lie inside the geo
+            for (cellId_t cellId : m_slabCellIdAVec[slabId]) {
+                bin = pSpec->headIdOffset + cellId;
+                crossingVec.clear();
+                traverseCellsSoA(m_pSimData->binOffsetVec[bin], 
+                    m_pSimData->binOffsetVec[bin + 1], cellId, crossingVec, boundStateVec);
+                const Vec3D<cellPos_t>& pos = m_pSimData->cellVec[cellId].pos;
+                for (const CellCrossing& crossing : crossingVec) {
+                    newCell.pos = {
+                        cellPos_t(pos.x + crossing.delta.x),
+                        cellPos_t(pos.y + crossing.delta.y),
+                        cellPos_t(pos.z + crossing.delta.z)};
+                    soa.cellId[crossing.stateId] = m_pSimData->cellIndex.cellId(newCell.pos);
+                }
+            }
+            // States of bound cells and states from other cells are pushed with the 
+            // boundary checks
+            for (cellId_t cellId : m_slabCellIdBVec[slabId]) {
+                bin = pSpec->headIdOffset + cellId;
+                for (stateId_t stateId = m_pSimData->binOffsetVec[bin]; 
+                    stateId < m_pSimData->binOffsetVec[bin + 1]; stateId++)
+                    boundStateVec.push_back(stateId);
+            }
+            // States that left the cylinder are reflected from the wall in a batch
+            batch.clear();
+            for (stateId_t stateId : boundStateVec) {
+                const Vec3D<cellPos_t>& pos = m_pSimData->cellVec[soa.cellId[stateId]].pos;
+                rx = soa.posX[stateId] + pos.x - geoCenter.x;
+                ry = soa.posY[stateId] + pos.y - geoCenter.y;
+                if (rx * rx + ry * ry > geoCenter.x*geoCenter.x)
+                    batch.push_back(stateId, soa.cellId[stateId], rx - soa.velX[stateId], 
+                        ry - soa.velY[stateId], soa.velX[stateId], soa.velY[stateId]);
+            }
+            reflectCylindricalBatch(batch, geoCenter.x);
+            scatterWallBatch(batch, geoCenter);
+            for (stateId_t stateId : boundStateVec)
+                pushStateBinnedBound(stateId);
+        });
+    }
+    return 0;
 }
 
-void parfis::Particle::stepStateUniformEz(Specie *pSpec, State *pState)
+/**
+ * @brief Push states of all species, for the box geometry
+ * @details Every cell of the box is full, so there is no wall test in the plane and the 
+ * cells are not split in groups. States of a specie are split in chunks, and every 
+ * thread advances its chunk with stepStatesSoA and then resolves the cell crossings 
+ * and the boundaries with boundStatesBox. Every state keeps its cell in 
+ * StateSoA::cellId, so the bins are not needed for the push and states are sorted 
+ * every CfgData::rebinPeriod evolve steps only to keep the states of a cell close in 
+ * memory.
+ * @return Zero on success
+ */
+int parfis::Particle::pushStatesBox()
 {
-    pState->vel.z += pSpec->dvUniformE.z;
-    pState->pos.x += pState->vel.x;
-    pState->pos.y += pState->vel.y;
-    pState->pos.z += pState->vel.z;
+    if (m_pSimData->evolveCnt > 0 && m_pSimData->evolveCnt % m_pCfgData->rebinPeriod == 0)
+        sortStatesBinned();
+    Specie *pSpec;
+    int threadCount = m_pThreadPool->size();
+    for (size_t specId = 0; specId < m_pSimData->specieVec.size(); specId++) {
+        pSpec = &m_pSimData->specieVec[specId];
+        // Specie is pushed every timestepRatio evolve steps
+        if (m_pSimData->evolveCnt % pSpec->timestepRatio != 0)
+            continue;
+        // Split the states of the specie in chunks aligned to the cache line
+        size_t chunk = (pSpec->stateCount + threadCount - 1) / threadCount;
+        chunk = (chunk + 15) / 16 * 16;
+        m_pThreadPool->run([&](int threadId) {
+            stateId_t first = pSpec->stateIdOffset + 
+                std::min(size_t(pSpec->stateCount), threadId*chunk);
+            stateId_t last = pSpec->stateIdOffset + 
+                std::min(size_t(pSpec->stateCount), (threadId + 1)*chunk);
+            stepStatesSoA(pSpec, first, last);
+            boundStatesBox(first, last);
+        });
+    }
+    return 0;
+}
+
+/**
+ * @brief Cell crossings and boundaries of states in the box geometry
+ * @param first id of the first state
+ * @param last id after the last state
+ */
+void parfis::Particle::boundStatesBox(stateId_t first, stateId_t last)
+{
+    StateSoA& soa = m_pSimData->stateSoA;
+    Vec3D<int> periodic = {
+        -int(m_pCfgData->periodicBoundary.x != 0), 
+        -int(m_pCfgData->periodicBoundary.y != 0),
+        -int(m_pCfgData->periodicBoundary.z != 0)};
+    boundStatesBox(last - first, 
+        soa.posX.data() + first, soa.posY.data() + first, soa.posZ.data() + first, 
+        soa.velX.data() + first, soa.velY.data() + first, soa.velZ.data() + first, 
+        soa.cellId.data() + first, m_pCfgData->cellCount, periodic);
+}
+
+/**
+ * @brief Kernel of Particle::boundStatesBox
+ * @details The loop has no branches, so the compiler vectorizes it, and the arrays are 
+ * restrict parameters so it doesn't have to check if they overlap. A state crosses at 
+ * most one cell in every direction. A state that leaves the box is wrapped to the other 
+ * side for the periodic boundary, or stays in its cell with the mirrored position and 
+ * velocity for the wall, and the two are selected with the masks. Cells of the box are 
+ * in the order of the loops over x, y and z, so the cell position is computed from the 
+ * cell id and back.
+ * @param n number of states
+ * @param cellId cells of the states (StateSoA::cellId)
+ * @param count number of cells in every direction
+ * @param periodic all bits set for the periodic boundary, zero for the wall
+ */
+void parfis::Particle::boundStatesBox(size_t n, 
+    state_t* __restrict posX, state_t* __restrict posY, state_t* __restrict posZ, 
+    state_t* __restrict velX, state_t* __restrict velY, state_t* __restrict velZ, 
+    cellId_t* __restrict cellId, Vec3D<int> count, Vec3D<int> periodic)
+{
+    const double invCountY = 1.0 / count.y;
+    const double invCountZ = 1.0 / count.z;
+    // Crossing in one direction, c is the cell position that is changed
+    auto boundAxis = [](state_t& pos, state_t& vel, int& c, int count, int periodic) {
+        int delta = int(pos > 1.0) - int(pos < 0.0);
+        c += delta;
+        int below = -int(c < 0);
+        int above = -int(c >= count);
+        // One for the wall crossing, the state is mirrored back in its cell
+        int mirror = (below | above) & ~periodic & 1;
+        state_t p = pos - delta;
+        pos = p + state_t(mirror)*(1 - 2*p);
+        vel *= state_t(1 - 2*mirror);
+        c += (periodic & ((count & below) - (count & above))) - (delta & -mirror);
+    };
+    for (size_t i = 0; i < n; i++) {
+        // Cell position from the id, the truncated quotients are exact since the 
+        // fractions are at least 0.5/count away from an integer
+        uint32_t column = uint32_t((double(cellId[i]) + 0.5)*invCountZ);
+        int cx = int((double(column) + 0.5)*invCountY);
+        int cy = int(column - uint32_t(cx)*count.y);
+        int cz = int(cellId[i] - column*count.z);
+        boundAxis(posX[i], velX[i], cx, count.x, periodic.x);
+        boundAxis(posY[i], velY[i], cy, count.y, periodic.y);
+        boundAxis(posZ[i], velZ[i], cz, count.z, periodic.z);
+        cellId[i] = (cellId_t(cx)*count.y + cy)*count.z + cz;
+    }
+}
+
+/**
+ * @brief Applies the cell crossing and the z-boundary to a single state for 
+ * StateLayout::Binned
+ * @details The wall reflection is done before, with Particle::reflectCylindricalBatch.
+ * @param stateId id of the state
+ */
+void parfis::Particle::pushStateBinnedBound(stateId_t stateId)
+{
+    StateSoA& soa = m_pSimData->stateSoA;
+    Cell* pCell = &m_pSimData->cellVec[soa.cellId[stateId]];
+    Cell newCell;
+    State state = soa.getState(stateId);
+    newCell.pos = pCell->pos;
+    traverseCell(state, newCell);
+    // Now check the z-boundary
+    if (m_pCfgData->periodicBoundary.z)
+        boundZ<true>(state, newCell);
+    else
+        boundZ<false>(state, newCell);
+    soa.setState(stateId, state);
+    if (newCell.pos != pCell->pos)
+        soa.cellId[stateId] = m_pSimData->cellIndex.cellId(newCell.pos);
+}
+
+/**
+ * @brief Sorts states in cell bins with a counting sort (StateLayout::Binned)
+ * @details Bins are ordered by specie and then by cell, so the states of a specie stay 
+ * in the same range of ids. Sets new SimData::binOffsetVec.
+ * @return Zero on success
+ */
+int parfis::Particle::sortStatesBinned()
+{
+    StateSoA& soa = m_pSimData->stateSoA;
+    std::vector<stateId_t>& offset = m_pSimData->binOffsetVec;
+    std::vector<stateId_t> dst(soa.size());
+    size_t bin;
+    // Count states in every bin
+    std::fill(offset.begin(), offset.end(), 0);
+    for (auto& spec : m_pSimData->specieVec)
+        for (stateId_t i = spec.stateIdOffset; i < spec.stateIdOffset + spec.stateCount; i++)
+            offset[spec.headIdOffset + soa.cellId[i] + 1]++;
+    // Running sum gives the bin offsets
+    for (bin = 1; bin < offset.size(); bin++)
+        offset[bin] += offset[bin - 1];
+    // Destination of every state, stable inside the bin
+    std::vector<stateId_t> pos(offset.begin(), offset.end() - 1);
+    for (auto& spec : m_pSimData->specieVec)
+        for (stateId_t i = spec.stateIdOffset; i < spec.stateIdOffset + spec.stateCount; i++)
+            dst[i] = pos[spec.headIdOffset + soa.cellId[i]]++;
+    // Move data with a single temporary array per type
+    AlignedVector<state_t> tmp(soa.size());
+    for (AlignedVector<state_t>* pVec : 
+        {&soa.posX, &soa.posY, &soa.posZ, &soa.velX, &soa.velY, &soa.velZ}) {
+        for (size_t i = 0; i < dst.size(); i++)
+            tmp[dst[i]] = (*pVec)[i];
+        pVec->swap(tmp);
+    }
+    AlignedVector<cellId_t> tmpCellId(soa.size());
+    for (size_t i = 0; i < dst.size(); i++)
+        tmpCellId[dst[i]] = soa.cellId[i];
+    soa.cellId.swap(tmpCellId);
+    return 0;
+}
+
+/**
+ * @brief Collisions of states with the background gas, with the null-collision technique
+ * @details Collisions of a specie are done in two passes over a CollisionBatch. 
+ * Particle::findColliders streams through the states and keeps only the ones that 
+ * collide, and Particle::scatterColliders selects the collision and changes the 
+ * velocity only for these states. States of a specie are split in chunks of 
+ * Particle::collisionChunk states, and every chunk has its own random stream, so 
+ * the chunks are shared among the threads and the result doesn't depend on the 
+ * number of threads.
+ * @return Zero on success
+ */
+int parfis::Particle::collideStates()
+{
+    // Velocities in units of the smallest cell size, same as Specie::maxVel
+    double minCellSize = std::min(m_pCfgData->cellSize.z, 
+        std::min(m_pCfgData->cellSize.x, m_pCfgData->cellSize.y));
+    Vec3D<double> velScale = {
+        m_pCfgData->cellSize.x/minCellSize, 
+        m_pCfgData->cellSize.y/minCellSize, 
+        m_pCfgData->cellSize.z/minCellSize};
+    const CollisionCounter& total = m_pSimData->collisionCounter;
+    for (auto& counter : m_collisionCounterVec)
+        counter.reset(total.binCnt, m_pSimData->specieVec.size(), 
+            m_pSimData->gasCollisionVec.size());
+    for (auto& spec : m_pSimData->specieVec) {
+        if (spec.gasCollisionVecId.size() == 0 || spec.maxColProb <= 0) continue;
+        if (m_pSimData->evolveCnt % spec.timestepRatio != 0) continue;
+        stateId_t chunkCount = (spec.stateCount + collisionChunk - 1)/collisionChunk;
+        int threadCount = m_pThreadPool->size();
+        m_pThreadPool->run([&](int threadId) {
+            CollisionBatch& batch = m_collisionBatchVec[threadId];
+            CollisionCounter& counter = m_collisionCounterVec[threadId];
+            batch.clear();
+            for (stateId_t chunk = chunkCount*threadId/threadCount; 
+                chunk < chunkCount*(threadId + 1)/threadCount; chunk++)
+                findColliders(spec, velScale, chunk, batch, counter);
+            scatterColliders(spec, velScale, batch, counter);
+        });
+    }
+    for (auto& counter : m_collisionCounterVec)
+        m_pSimData->collisionCounter.add(counter);
+    return 0;
+}
+
+/**
+ * @brief First pass of the collisions, finds the states of a chunk that collide
+ * @details Every state is a collision candidate with the same probability 
+ * Specie::maxColProb, the maximum of the total collision probability over the 
+ * velocities from the table. Candidates are found by skipping a geometrically 
+ * distributed number of states, so the states that are not candidates use neither 
+ * random numbers nor the table. Candidates get a random number r from 
+ * [0, maxColProb), and the total collision probabilities of all candidates are 
+ * evaluated at once with SIMD gathers (from SimData::colProbTableVec if the float 
+ * tables are used, otherwise from SimData::gasCollisionProbVec). Candidates with 
+ * r above the total probability have the null collision and are removed from the batch 
+ * without branches per state. If maxColProb is so small that the skip is not finite, 
+ * every state is a candidate with r from [0, 1).
+ * @param spec the specie
+ * @param velScale cell size in units of the smallest cell size
+ * @param chunk index of the chunk of Particle::collisionChunk states
+ * @param batch batch where the states that collide are appended
+ * @param counter counters of the collisions of this thread
+ */
+void parfis::Particle::findColliders(const Specie& spec, const Vec3D<double>& velScale, 
+    stateId_t chunk, CollisionBatch& batch, CollisionCounter& counter)
+{
+    typedef simd::Pack<double> Pack;
+    bool aos = m_pCfgData->stateLayout == StateLayout::AoS;
+    StateSoA& soa = m_pSimData->stateSoA;
+    RandomStream rnd(spec.randomKey, spec.id, chunk, m_pSimData->evolveCnt, 
+        RandomStreamId::FindColliders);
+    // Probability of a candidate, log1p keeps the precision for small probabilities. If 
+    // the logarithm is zero or the longest skip (1 - u is not below 2^-53) is not finite, 
+    // every state is a candidate.
+    double candidateProb = spec.maxColProb;
+    double logNullProb = log1p(-candidateProb);
+    bool everyState = !(logNullProb < 0.0) || 
+        !std::isfinite(log(std::ldexp(1.0, -53))/logNullProb);
+    if (everyState)
+        candidateProb = 1.0;
+    stateId_t i = spec.stateIdOffset + chunk*collisionChunk;
+    stateId_t last = std::min(i + collisionChunk, spec.stateIdOffset + spec.stateCount);
+    size_t first = batch.size();
+    while (true) {
+        // Number of states before the next candidate, 1 - u is in (0, 1]
+        double skip = everyState ? 0.0 : floor(log(1.0 - rnd.uniform())/logNullProb);
+        if (skip >= double(last - i)) break;
+        i += stateId_t(skip);
+        if (aos)
+            batch.push_back(i, m_pSimData->stateVec[i].vel.x*velScale.x, 
+                m_pSimData->stateVec[i].vel.y*velScale.y, 
+                m_pSimData->stateVec[i].vel.z*velScale.z, candidateProb*rnd.uniform());
+        else
+            batch.push_back(i, soa.velX[i]*velScale.x, soa.velY[i]*velScale.y, 
+                soa.velZ[i]*velScale.z, candidateProb*rnd.uniform());
+        i++;
+    }
+    // Every candidate is counted as the null collision, Particle::scatterColliders 
+    // moves the real collisions to their counters
+    size_t n = batch.size();
+    uint64_t* pNullCnt = counter.nullCollisionCntVec.data() + spec.id*counter.binCnt;
+    for (size_t j = first; j < n; j++)
+        pNullCnt[counter.bin(batch.velSq[j])]++;
+    // Total collision probability is the last column
+    if (m_pSimData->colProbTableVec.size()) {
+        const ColProbTable& tab = m_pSimData->colProbTableVec[spec.gasCollisionProbId];
+        tab.evalBatch(batch.velSq.data() + first, n - first, batch.prob.data() + first, 
+            tab.colCnt - 1);
+    }
+    else {
+        const FuncTable& ftab = m_pSimData->gasCollisionProbVec[spec.gasCollisionProbId];
+        ftab.evalBatch(batch.velSq.data() + first, n - first, batch.prob.data() + first, 
+            ftab.colCnt - 1);
+    }
+    // Keep only real collisions, lanes are tested together
+    size_t k = first, j = first;
+    for (; j + Pack::width <= n; j += Pack::width) {
+        unsigned collide = simd::bits(simd::cmpLt(
+            Pack::load(batch.rand.data() + j), Pack::load(batch.prob.data() + j)));
+        for (; collide; collide &= collide - 1)
+            batch.copy(k++, j + __builtin_ctz(collide));
+    }
+    for (; j < n; j++) {
+        batch.copy(k, j);
+        k += batch.rand[j] < batch.prob[j];
+    }
+    batch.resize(k);
+}
+
+/**
+ * @brief Second pass of the collisions, changes velocities of the states that collide
+ * @details The random number of the state over the total probability selects the 
+ * collision from the alias table of its row (SimData::colAliasTableVec). The gas particle is at rest, so the relative 
+ * velocity is the velocity of the state. The deflection of the relative velocity in 
+ * the center of mass frame is sampled in constant time from the inverse cumulative 
+ * distribution (GasCollision::scatterAngle, interpolated in cosine), and the relative 
+ * velocity squared decreases by GasCollision::lossSq for the inelastic collision (down 
+ * to zero). The elastic energy loss follows from the velocity of the center of mass. 
+ * Collisions are selected per state, and the velocities of the batch are rotated with 
+ * SIMD. Random numbers of a state are from its own random stream.
+ * @param spec the specie
+ * @param velScale cell size in units of the smallest cell size
+ * @param batch batch with the states that collide, from Particle::findColliders
+ * @param counter counters of the collisions of this thread
+ */
+void parfis::Particle::scatterColliders(const Specie& spec, const Vec3D<double>& velScale, 
+    CollisionBatch& batch, CollisionCounter& counter)
+{
+    typedef simd::Pack<double> Pack;
+    bool aos = m_pCfgData->stateLayout == StateLayout::AoS;
+    StateSoA& soa = m_pSimData->stateSoA;
+    double u[2];
+    const FuncTable& probFtab = m_pSimData->gasCollisionProbVec[spec.gasCollisionProbId];
+    const ColProbTable* pColTab = m_pSimData->colProbTableVec.size() ? 
+        &m_pSimData->colProbTableVec[spec.gasCollisionProbId] : nullptr;
+    const ColAliasTable& alias = m_pSimData->colAliasTableVec[spec.gasCollisionProbId];
+    size_t n = batch.size();
+    for (size_t k = 0; k < n; k++) {
+        double velSq = batch.velSq[k];
+        // Random number r is uniform below the total probability
+        int row = pColTab != nullptr ? pColTab->index(velSq) : int(probFtab.xIndex(velSq));
+        int j = alias.sample(row, batch.rand[k]/batch.prob[k]);
+        const GasCollision& gasCol = m_pSimData->gasCollisionVec[spec.gasCollisionVecId[j]];
+        RandomStream(spec.randomKey, spec.id, batch.stateId[k], m_pSimData->evolveCnt, 
+            RandomStreamId::ScatterColliders).uniform(u, 2);
+        batch.cosIndex[k] = gasCol.scatterCosId + u[0]*(gasCol.scatterAngle.size() - 1);
+        batch.lossSq[k] = gasCol.lossSq;
+        batch.massRatio[k] = gasCol.massRatio;
+        batch.azimuth[k] = u[1];
+        batch.gasCollisionId[k] = gasCol.id;
+        int b = counter.bin(velSq);
+        counter.nullCollisionCntVec[spec.id*counter.binCnt + b]--;
+        counter.collisionCntVec[gasCol.id*counter.binCnt + b]++;
+    }
+    // Lanes after the last state are zero, the rotation gives no NaNs for them
+    batch.resize((n + Pack::width - 1)/Pack::width*Pack::width);
+    const double* pCos = spec.scatterCosVec.data();
+    Pack one = Pack::set1(1.0);
+    Pack zero = Pack::set1(0.0);
+    Pack tiny = Pack::set1(1e-12);
+    Pack tinySq = Pack::set1(1e-300);
+    Pack twoPi = Pack::set1(2.0*Const::pi);
+    Pack pi = Pack::set1(Const::pi);
+    for (size_t k = 0; k < n; k += Pack::width) {
+        Pack vx = Pack::load(batch.velX.data() + k);
+        Pack vy = Pack::load(batch.velY.data() + k);
+        Pack vz = Pack::load(batch.velZ.data() + k);
+        Pack velSq = Pack::load(batch.velSq.data() + k);
+        // Deflection from the inverse cumulative distribution, linear in cosine
+        Pack idx = Pack::load(batch.cosIndex.data() + k);
+        Pack idx0 = simd::floor(idx);
+        Pack cos0 = simd::gather(pCos, idx0);
+        Pack cosChi = simd::fmadd(idx - idx0, simd::gather(pCos, idx0 + one) - cos0, cos0);
+        Pack sinChi = simd::sqrt(simd::max(zero, one - cosChi*cosChi));
+        Pack sinPhi, cosPhi;
+        simd::sincos(simd::fmadd(Pack::load(batch.azimuth.data() + k), twoPi, zero - pi), 
+            sinPhi, cosPhi);
+        // Unit vector of the relative velocity, rotated by the deflection
+        Pack ig = one/simd::sqrt(simd::max(velSq, tinySq));
+        Pack ex = vx*ig;
+        Pack ey = vy*ig;
+        Pack ez = vz*ig;
+        Pack perp = simd::sqrt(ey*ey + ez*ez);
+        Pack iperp = one/simd::max(perp, tiny);
+        Pack sc = sinChi*cosPhi;
+        Pack ss = sinChi*sinPhi;
+        Pack nx = simd::fmadd(ex, cosChi, perp*sc);
+        Pack ny = simd::fmadd(ey, cosChi, (ez*ss - ex*ey*sc)*iperp);
+        Pack nz = ez*cosChi - (ey*ss + ex*ez*sc)*iperp;
+        // Relative velocity along x, the rotation is around x
+        auto alongX = simd::cmpLt(perp, tiny);
+        ny = simd::blend(alongX, ny, sc);
+        nz = simd::blend(alongX, nz, ss);
+        // Velocity of the center of mass plus the relative velocity after the collision
+        Pack mr = Pack::load(batch.massRatio.data() + k);
+        Pack g = mr*simd::sqrt(simd::max(zero, velSq - Pack::load(batch.lossSq.data() + k)));
+        Pack mc = one - mr;
+        simd::fmadd(mc, vx, g*nx).store(batch.velX.data() + k);
+        simd::fmadd(mc, vy, g*ny).store(batch.velY.data() + k);
+        simd::fmadd(mc, vz, g*nz).store(batch.velZ.data() + k);
+    }
+    for (size_t k = 0; k < n; k++) {
+        stateId_t i = batch.stateId[k];
+        double velSq = batch.velX[k]*batch.velX[k] + batch.velY[k]*batch.velY[k] + 
+            batch.velZ[k]*batch.velZ[k];
+        counter.energyLossVec[batch.gasCollisionId[k]*counter.binCnt + 
+            counter.bin(batch.velSq[k])] += spec.maxEv*(batch.velSq[k] - velSq);
+        if (aos) {
+            m_pSimData->stateVec[i].vel.x = batch.velX[k]/velScale.x;
+            m_pSimData->stateVec[i].vel.y = batch.velY[k]/velScale.y;
+            m_pSimData->stateVec[i].vel.z = batch.velZ[k]/velScale.z;
+        }
+        else {
+            soa.velX[i] = batch.velX[k]/velScale.x;
+            soa.velY[i] = batch.velY[k]/velScale.y;
+            soa.velZ[i] = batch.velZ[k]/velScale.z;
+        }
+    }
+}
+
+/**
+ * @brief Vectorized kernel that advances positions and velocities of states of one 
+ * specie, for states stored in StateLayout::SoA
+ * @details Velocity is increased by the uniform electric field (if any), or advanced with 
+ * the Boris scheme for the uniform magnetic field, and the position is increased by the 
+ * velocity. Every instruction advances simd::Pack<state_t>::width states.
+ * @param pSpec pointer to the specie
+ * @param first id of the first state
+ * @param last id after the last state
+ */
+void parfis::Particle::stepStatesSoA(Specie *pSpec, stateId_t first, stateId_t last)
+{
+    typedef simd::Pack<state_t> Pack;
+    constexpr size_t w = Pack::width;
+    StateSoA& soa = m_pSimData->stateSoA;
+    state_t* px = soa.posX.data() + first;
+    state_t* py = soa.posY.data() + first;
+    state_t* pz = soa.posZ.data() + first;
+    state_t* vx = soa.velX.data() + first;
+    state_t* vy = soa.velY.data() + first;
+    state_t* vz = soa.velZ.data() + first;
+    size_t n = last - first;
+    size_t i = 0;
+    if (m_pSimData->field.typeB != Vec3D<int>{0, 0, 0}) {
+        // Same operations as in stepState<FieldType::UniformEB>
+        Pack hdvx = Pack::set1(0.5*pSpec->dvUniformE.x);
+        Pack hdvy = Pack::set1(0.5*pSpec->dvUniformE.y);
+        Pack hdvz = Pack::set1(0.5*pSpec->dvUniformE.z);
+        Pack csx = Pack::set1(pSpec->cellScale.x);
+        Pack csy = Pack::set1(pSpec->cellScale.y);
+        Pack csz = Pack::set1(pSpec->cellScale.z);
+        Pack tx = Pack::set1(pSpec->borisT.x);
+        Pack ty = Pack::set1(pSpec->borisT.y);
+        Pack tz = Pack::set1(pSpec->borisT.z);
+        Pack bs = Pack::set1(pSpec->borisS);
+        Pack ux, uy, uz, wx, wy, wz;
+        for (; i + w <= n; i += w) {
+            // Half of the electric impulse, in scaled units
+            ux = (Pack::load(vx + i) + hdvx) * csx;
+            uy = (Pack::load(vy + i) + hdvy) * csy;
+            uz = (Pack::load(vz + i) + hdvz) * csz;
+            // v' = v + v x t
+            wx = ux + uy * tz - uz * ty;
+            wy = uy + uz * tx - ux * tz;
+            wz = uz + ux * ty - uy * tx;
+            // v = v + v' x s
+            ux = ux + bs * (wy * tz - wz * ty);
+            uy = uy + bs * (wz * tx - wx * tz);
+            uz = uz + bs * (wx * ty - wy * tx);
+            ux = ux / csx + hdvx;
+            uy = uy / csy + hdvy;
+            uz = uz / csz + hdvz;
+            ux.store(vx + i);
+            uy.store(vy + i);
+            uz.store(vz + i);
+            (Pack::load(px + i) + ux).store(px + i);
+            (Pack::load(py + i) + uy).store(py + i);
+            (Pack::load(pz + i) + uz).store(pz + i);
+        }
+        State state;
+        for (; i < n; i++) {
+            state = soa.getState(first + i);
+            stepState<FieldType::UniformEB>(pSpec, state);
+            soa.setState(first + i, state);
+        }
+    }
+    else if (m_pSimData->field.typeE == Vec3D<int>{0, 0, 0}) {
+        for (; i + w <= n; i += w) {
+            (Pack::load(px + i) + Pack::load(vx + i)).store(px + i);
+            (Pack::load(py + i) + Pack::load(vy + i)).store(py + i);
+            (Pack::load(pz + i) + Pack::load(vz + i)).store(pz + i);
+        }
+        for (; i < n; i++) {
+            px[i] += vx[i];
+            py[i] += vy[i];
+            pz[i] += vz[i];
+        }
+    }
+    else {
+        state_t dvx = pSpec->dvUniformE.x;
+        state_t dvy = pSpec->dvUniformE.y;
+        state_t dvz = pSpec->dvUniformE.z;
+        Pack dvxPack = Pack::set1(dvx);
+        Pack dvyPack = Pack::set1(dvy);
+        Pack dvzPack = Pack::set1(dvz);
+        Pack vel;
+        for (; i + w <= n; i += w) {
+            vel = Pack::load(vx + i) + dvxPack;
+            vel.store(vx + i);
+            (Pack::load(px + i) + vel).store(px + i);
+            vel = Pack::load(vy + i) + dvyPack;
+            vel.store(vy + i);
+            (Pack::load(py + i) + vel).store(py + i);
+            vel = Pack::load(vz + i) + dvzPack;
+            vel.store(vz + i);
+            (Pack::load(pz + i) + vel).store(pz + i);
+        }
+        for (; i < n; i++) {
+            vx[i] += dvx;
+            px[i] += vx[i];
+            vy[i] += dvy;
+            py[i] += vy[i];
+            vz[i] += dvz;
+            pz[i] += vz[i];
+        }
+    }
+}
+
+/**
+ * @brief Calculates the velocity change for the uniform electric field
+ * @details Velocity change is in computational units: DV = (q*E*dt^2)/(m*CellLength), 
+ * where dt is the timestep of the specie (Specie::dt).
+ * @param pSpec pointer to the specie
+ */
+void parfis::Particle::calculateDvUniformE(Specie *pSpec)
+{
+    pSpec->dvUniformE.x = m_pSimData->field.strengthE.x*(pSpec->charge*Const::eCharge * 
+        pSpec->dt * pSpec->dt)/
+        (pSpec->amuMass*Const::amuKg * m_pCfgData->cellSize.x);
+
+    pSpec->dvUniformE.y = m_pSimData->field.strengthE.y*(pSpec->charge*Const::eCharge * 
+        pSpec->dt * pSpec->dt)/
+        (pSpec->amuMass*Const::amuKg * m_pCfgData->cellSize.y);
+
+    pSpec->dvUniformE.z = m_pSimData->field.strengthE.z*(pSpec->charge*Const::eCharge * 
+        pSpec->dt * pSpec->dt)/
+        (pSpec->amuMass*Const::amuKg * m_pCfgData->cellSize.z);
+
+    // Only directions with uniform field get the velocity increase
+    if (m_pSimData->field.typeE.x != 1) pSpec->dvUniformE.x = 0;
+    if (m_pSimData->field.typeE.y != 1) pSpec->dvUniformE.y = 0;
+    if (m_pSimData->field.typeE.z != 1) pSpec->dvUniformE.z = 0;
+}
+
+/**
+ * @brief Calculates the coefficients of the Boris rotation for the uniform magnetic field
+ * @details The rotation vector is t = q*B*dt/(2*m) and the coefficient for the second 
+ * half of the rotation is 2/(1 + t^2). Velocities are rotated in units of cellSize.x, 
+ * with the scale of every direction kept in Specie::cellScale.
+ * @param pSpec pointer to the specie
+ */
+void parfis::Particle::calculateBorisCoef(Specie *pSpec)
+{
+    double halfQmDt = 0.5*pSpec->charge*pSpec->dt/pSpec->mass;
+    Vec3D<int>& typeB = m_pSimData->field.typeB;
+    Vec3D<double>& strengthB = m_pSimData->field.strengthB;
+    pSpec->borisT.x = typeB.x == 1 ? halfQmDt*strengthB.x : 0.0;
+    pSpec->borisT.y = typeB.y == 1 ? halfQmDt*strengthB.y : 0.0;
+    pSpec->borisT.z = typeB.z == 1 ? halfQmDt*strengthB.z : 0.0;
+    pSpec->borisS = 2.0/(1.0 + pSpec->borisT.x*pSpec->borisT.x + 
+        pSpec->borisT.y*pSpec->borisT.y + pSpec->borisT.z*pSpec->borisT.z);
+    pSpec->cellScale.x = 1.0;
+    pSpec->cellScale.y = m_pCfgData->cellSize.y/m_pCfgData->cellSize.x;
+    pSpec->cellScale.z = m_pCfgData->cellSize.z/m_pCfgData->cellSize.x;
+}
+
+/**
+ * @brief Vectorized cell crossing for the states of a bin (StateLayout::Binned)
+ * @details Positions are wrapped into the cell without branches, using the SIMD 
+ * comparisons with the cell bounds. The lanes that crossed to another cell are found 
+ * from the comparison masks and only these states are appended to crossingVec. 
+ * States whose cell differs from the cell of the bin (the bin is not sorted since they 
+ * moved) are not changed and are appended to staleVec.
+ * @param first id of the first state of the bin
+ * @param last id after the last state of the bin
+ * @param cellId cell of the bin
+ * @param crossingVec states that crossed to a neighbouring cell with the cell deltas
+ * @param staleVec states from another cell
+ */
+void parfis::Particle::traverseCellsSoA(stateId_t first, stateId_t last, cellId_t cellId,
+    std::vector<CellCrossing>& crossingVec, std::vector<stateId_t>& staleVec)
+{
+    typedef simd::Pack<state_t> Pack;
+    constexpr size_t w = Pack::width;
+    StateSoA& soa = m_pSimData->stateSoA;
+    state_t* pos[3] = {
+        soa.posX.data() + first, soa.posY.data() + first, soa.posZ.data() + first};
+    const cellId_t* pCellId = soa.cellId.data() + first;
+    size_t n = last - first;
+    size_t i = 0;
+    // Branch free crossing of a single state
+    auto traverseState = [&](size_t j) {
+        int8_t delta[3];
+        for (int k = 0; k < 3; k++) {
+            delta[k] = int8_t(pos[k][j] > 1.0) - int8_t(pos[k][j] < 0.0);
+            pos[k][j] -= delta[k];
+        }
+        if (delta[0] | delta[1] | delta[2])
+            crossingVec.push_back({stateId_t(first + j), {delta[0], delta[1], delta[2]}});
+    };
+    Pack zero = Pack::set1(0.0);
+    Pack one = Pack::set1(1.0);
+    Pack p;
+    typename Pack::Mask lt, gt;
+    state_t delta[3][w];
+    unsigned stale, moved;
+    for (; i + w <= n; i += w) {
+        stale = simd::neqBits<state_t>(pCellId + i, cellId);
+        if (stale) {
+            for (size_t j = 0; j < w; j++) {
+                if (stale >> j & 1)
+                    staleVec.push_back(stateId_t(first + i + j));
+                else
+                    traverseState(i + j);
+            }
+            continue;
+        }
+        moved = 0;
+        for (int k = 0; k < 3; k++) {
+            p = Pack::load(pos[k] + i);
+            lt = simd::cmpLt(p, zero);
+            gt = simd::cmpGt(p, one);
+            moved |= simd::bits(lt) | simd::bits(gt);
+            Pack d = simd::select(gt, one) - simd::select(lt, one);
+            d.store(delta[k]);
+            (p - d).store(pos[k] + i);
+        }
+        for (size_t j = 0; moved; j++, moved >>= 1)
+            if (moved & 1)
+                crossingVec.push_back({stateId_t(first + i + j), 
+                    {int8_t(delta[0][j]), int8_t(delta[1][j]), int8_t(delta[2][j])}});
+    }
+    for (; i < n; i++) {
+        if (pCellId[i] != cellId)
+            staleVec.push_back(stateId_t(first + i));
+        else
+            traverseState(i);
+    }
 }
 
 void parfis::Particle::traverseCell(State& state, Cell& newCell)
@@ -474,88 +1542,190 @@ void parfis::Particle::traverseCell(State& state, Cell& newCell)
     }
 }
 
-int parfis::Particle::reflectCylindrical(State& state, Cell& cell, Vec3D<double>& geoCenter,
-    double invRadius) 
+/**
+ * @brief Reflects states from the cylinder wall, several states with a single SIMD 
+ * instruction
+ * @details For every state the point where the trajectory crosses the wall is found from 
+ * the quadratic equation |r + v*t| = R, the velocity is mirrored around the normal of the 
+ * wall and the state is pushed for the rest of the timestep. Near tangent trajectories 
+ * can hit the wall several times in a single timestep, so the reflection is repeated, 
+ * for at most Particle::maxWallReflections times. States that are still outside after 
+ * that are put back on the wall along the radius.
+ * @param batch states that left the cylinder, see WallBatch
+ * @param radius radius of the cylinder in cells
+ * @return Number of repeated reflections
+ */
+int parfis::Particle::reflectCylindricalBatch(WallBatch& batch, double radius)
 {
-    bool reflect = true;
+    typedef simd::Pack<double> Pack;
+    constexpr size_t w = Pack::width;
+    size_t n = batch.size();
+    // Lanes after the last state have zero position and velocity and are not reflected
+    size_t nPad = (n + w - 1) / w * w;
+    for (AlignedVector<double>* pVec : 
+        {&batch.posX, &batch.posY, &batch.velX, &batch.velY})
+        pVec->resize(nPad, 0.0);
     int retval = 0;
-    double timeStep = 1.0, tau;
-    state_t rx, ry, vx, vy;
-    double a, b, c;
-    double ux, uy, cr, sr;
-    while (reflect) {
-        // First we find point of reflection
-        rx = state.pos.x + cell.pos.x - geoCenter.x;
-        ry = state.pos.y + cell.pos.y - geoCenter.y;
-        vx = state.vel.x;
-        vy = state.vel.y;
-        a = (vx * vx + vy * vy) * timeStep;
-        b = 2.0*(rx * vx + ry * vy);
-        c = rx * rx + ry * ry - geoCenter.x*geoCenter.x;
-        tau = 0.5*(sqrt(b*b - 4.0*a*c) - b) / a;
-        // Push particle to point of reflection (rx, ry)
-        state.pos.x += vx * tau;
-        state.pos.y += vy * tau;
-        rx = state.pos.x + cell.pos.x - geoCenter.x;
-        ry = state.pos.y + cell.pos.y - geoCenter.y;
-        // Cosine and sine of rotation
-        cr = rx * invRadius;
-        sr = ry * invRadius;
-        // Velocity vector before reflection in the rotated coord. sys.
-        ux =  vx * cr + vy * sr;
-        uy =  vy * cr - vx * sr;
-        // Set velocity and position vector of the original coord. sys.
-        vx = -ux * cr - uy * sr;
-        vy =  uy * cr - ux * sr;
-        // Push particle to final position
-        timeStep -= tau;
-        state.pos.x += vx * timeStep;
-        state.pos.y += vy * timeStep;
-        state.vel.x = vx;
-        state.vel.y = vy;
-        // If traectory is close to tangent - multiple reflection can happen in a single timestep
-        rx = state.pos.x + cell.pos.x - geoCenter.x;
-        ry = state.pos.y + cell.pos.y - geoCenter.y;
-        if (rx * rx + ry * ry > geoCenter.x*geoCenter.x) {
-            // Reflect back to the boundary and repeat reflection process
-            state.pos.x -= vx * timeStep;
-            state.pos.y -= vy * timeStep;
-            retval++;
+    Pack zero = Pack::set1(0.0);
+    Pack one = Pack::set1(1.0);
+    Pack two = Pack::set1(2.0);
+    Pack tiny = Pack::set1(std::numeric_limits<double>::min());
+    Pack radiusSquared = Pack::set1(radius*radius);
+    Pack invRadius = Pack::set1(1.0/radius);
+    Pack rx, ry, vx, vy, timeStep, ex, ey, a, b, c, tau, px, py, un;
+    typename Pack::Mask out;
+    for (size_t i = 0; i < nPad; i += w) {
+        rx = Pack::load(&batch.posX[i]);
+        ry = Pack::load(&batch.posY[i]);
+        vx = Pack::load(&batch.velX[i]);
+        vy = Pack::load(&batch.velY[i]);
+        timeStep = one;
+        for (int iter = 0; iter < maxWallReflections; iter++) {
+            // Lanes that end outside of the cylinder
+            ex = rx + vx * timeStep;
+            ey = ry + vy * timeStep;
+            out = simd::cmpGt(ex * ex + ey * ey, radiusSquared);
+            if (!simd::bits(out))
+                break;
+            if (iter > 0)
+                retval += int(std::bitset<32>(simd::bits(out)).count());
+            // Positive root of a*t^2 + 2*b*t + c = 0, the start is inside so c <= 0
+            a = simd::max(vx * vx + vy * vy, tiny);
+            b = rx * vx + ry * vy;
+            c = simd::min(rx * rx + ry * ry - radiusSquared, zero);
+            tau = (simd::sqrt(b * b - a * c) - b) / a;
+            tau = simd::max(simd::min(tau, timeStep), zero);
+            // Point of reflection
+            px = rx + vx * tau;
+            py = ry + vy * tau;
+            // Mirror the velocity around the normal of the wall
+            un = (vx * px + vy * py) * invRadius * invRadius * two;
+            rx = simd::blend(out, rx, px);
+            ry = simd::blend(out, ry, py);
+            vx = simd::blend(out, vx, vx - un * px);
+            vy = simd::blend(out, vy, vy - un * py);
+            timeStep = simd::blend(out, timeStep, timeStep - tau);
         }
-        else {
-            reflect = false;
+        // Push for the rest of the timestep
+        rx = rx + vx * timeStep;
+        ry = ry + vy * timeStep;
+        // Trajectories along the wall that are still outside are put on the wall
+        c = rx * rx + ry * ry;
+        out = simd::cmpGt(c, radiusSquared);
+        if (simd::bits(out)) {
+            a = simd::blend(out, one, simd::sqrt(radiusSquared / c));
+            rx = rx * a;
+            ry = ry * a;
         }
+        rx.store(&batch.posX[i]);
+        ry.store(&batch.posY[i]);
+        vx.store(&batch.velX[i]);
+        vy.store(&batch.velY[i]);
     }
+    for (AlignedVector<double>* pVec : 
+        {&batch.posX, &batch.posY, &batch.velX, &batch.velY})
+        pVec->resize(n);
     return retval;
 }
 
-void parfis::Particle::setNewCell(State& state, size_t headIdPos, size_t newHeadIdPos)
+/**
+ * @brief Copies positions and velocities of reflected states back to the states
+ * @param batch states after Particle::reflectCylindricalBatch
+ * @param geoCenter center of the geometry
+ */
+void parfis::Particle::scatterWallBatch(const WallBatch& batch, Vec3D<double>& geoCenter)
 {
-    stateId_t stateId;
-    // If the state is not the head state (has prev)
-    if (state.prev != Const::noStateId) {
-        stateId = m_pSimData->stateVec[state.prev].next;
-        // Connect prev and next from the old cell (prev->next)
-        m_pSimData->stateVec[state.prev].next = state.next;
-    }
-    // If the state is a head state (doesn't have prev)
-    else {
-        stateId = m_pSimData->headIdVec[headIdPos];
-        // Connect head pointer to next from the old cell (head->next)
-        m_pSimData->headIdVec[headIdPos] = state.next;
+    const Cell* pCell;
+    state_t x, y;
+    bool aos = m_pCfgData->stateLayout == StateLayout::AoS;
+    StateSoA& soa = m_pSimData->stateSoA;
+    for (size_t i = 0; i < batch.size(); i++) {
+        pCell = &m_pSimData->cellVec[batch.cellId[i]];
+        x = batch.posX[i] + geoCenter.x - pCell->pos.x;
+        y = batch.posY[i] + geoCenter.y - pCell->pos.y;
+        if (aos) {
+            State& state = m_pSimData->stateVec[batch.stateId[i]];
+            state.pos.x = x;
+            state.pos.y = y;
+            state.vel.x = batch.velX[i];
+            state.vel.y = batch.velY[i];
+        }
+        else {
+            soa.posX[batch.stateId[i]] = x;
+            soa.posY[batch.stateId[i]] = y;
+            soa.velX[batch.stateId[i]] = batch.velX[i];
+            soa.velY[batch.stateId[i]] = batch.velY[i];
+        }
     }
+}
 
+/**
+ * @brief Removes the state from the list of its cell
+ * @details The next and prev values of the state are not changed.
+ * @param state the state
+ * @param headIdPos position in headIdVec of the cell
+ */
+void parfis::Particle::unlinkState(State& state, size_t headIdPos)
+{
+    // Connect prev and next from the old cell (prev->next)
+    if (state.prev != Const::noStateId)
+        m_pSimData->stateVec[state.prev].next = state.next;
+    // Connect head pointer to next from the old cell (head->next)
+    else
+        m_pSimData->headIdVec[headIdPos] = state.next;
     // If the state is not the last state (has next)
     if (state.next != Const::noStateId)
         // Connect prev and next from the old cell (prev<-next)
         m_pSimData->stateVec[state.next].prev = state.prev;
+}
 
-    // Set new cell values for the state (state becomes head in the new cell)
+/**
+ * @brief Adds the state as the head of the list of a cell
+ * @param stateId id of the state
+ * @param headIdPos position in headIdVec of the cell
+ */
+void parfis::Particle::linkState(stateId_t stateId, size_t headIdPos)
+{
+    State& state = m_pSimData->stateVec[stateId];
     state.prev = Const::noStateId;
-    state.next = m_pSimData->headIdVec[newHeadIdPos];
-    m_pSimData->headIdVec[newHeadIdPos] = stateId;
-
+    state.next = m_pSimData->headIdVec[headIdPos];
+    m_pSimData->headIdVec[headIdPos] = stateId;
     // If there was a head before (in the new cell) then set its prev pointer to the new head
     if (state.next != Const::noStateId)
         m_pSimData->stateVec[state.next].prev = stateId;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Removes the state from the list of its cell, for StateLayout::SoA
+ * @details The next and prev values of the state are not changed.
+ * @param stateId id of the state
+ * @param headIdPos position in headIdVec of the cell
+ */
+void parfis::Particle::unlinkStateSoA(stateId_t stateId, size_t headIdPos)
+{
+    StateSoA& soa = m_pSimData->stateSoA;
+    stateId_t next = soa.next[stateId];
+    stateId_t prev = soa.prev[stateId];
+    // Connect prev and next from the old cell
+    if (prev != Const::noStateId)
+        soa.next[prev] = next;
+    else
+        m_pSimData->headIdVec[headIdPos] = next;
+    if (next != Const::noStateId)
+        soa.prev[next] = prev;
+}
+
+/**
+ * @brief Adds the state as the head of the list of a cell, for StateLayout::SoA
+ * @param stateId id of the state
+ * @param headIdPos position in headIdVec of the cell
+ */
+void parfis::Particle::linkStateSoA(stateId_t stateId, size_t headIdPos)
+{
+    StateSoA& soa = m_pSimData->stateSoA;
+    soa.prev[stateId] = Const::noStateId;
+    soa.next[stateId] = m_pSimData->headIdVec[headIdPos];
+    if (soa.next[stateId] != Const::noStateId)
+        soa.prev[soa.next[stateId]] = stateId;
+    m_pSimData->headIdVec[headIdPos] = stateId;
+}
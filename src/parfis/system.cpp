@@ -1,6 +1,8 @@
 #include <fstream>
+#include <thread>
 #include "system.h"
 #include "global.h"
+#include "threadpool.h"
 
 /**
  * @brief Loads data into CfgData object 
@@ -16,6 +18,15 @@ int parfis::System::loadCfgData()
     getParamToValue("cellSize", m_pCfgData->cellSize);
     getParamToValue("periodicBoundary", m_pCfgData->periodicBoundary);
     getParamToVector("gas", m_pCfgData->gasNameVec);
+    int retVal = getParamToValue("threads", m_pCfgData->threads);
+    if (retVal) m_pCfgData->threads = ParamDefault::threads;
+    // Zero means all available hardware threads
+    if (m_pCfgData->threads <= 0)
+        m_pCfgData->threads = std::max(1, int(std::thread::hardware_concurrency()));
+    retVal = getParamToValue("cellOrder", m_pCfgData->cellOrder);
+    if (retVal || m_pCfgData->cellOrder < CellOrder::Loop || 
+        m_pCfgData->cellOrder > CellOrder::Hilbert)
+        m_pCfgData->cellOrder = ParamDefault::cellOrder;
 
     m_pCfgData->cellCount.x = cellId_t(ceil(
         m_pCfgData->geometrySize.x / m_pCfgData->cellSize.x));
@@ -65,10 +76,6 @@ int parfis::System::loadSimData()
             m_pSimData->gasVec[i].molDensity);
     }
 
-    // Create vector for cell id
-    m_pSimData->cellIdVec.resize(
-        m_pCfgData->cellCount.x*m_pCfgData->cellCount.y*m_pCfgData->cellCount.z, Const::noCellId);
-
     // Set command for creating cells
     Command *pcom;
     std::string cmdChainName = "create";
@@ -89,6 +96,12 @@ int parfis::System::loadSimData()
                 std::string msg = "createCells command defined with " + pcom->m_funcName + "\n";
                 LOG(*m_pLogger, LogMask::Info, msg);
             }
+            else if (m_pCfgData->geometry == 0) {
+                pcom->m_func = [&]()->int { return createCellsBox(); };
+                pcom->m_funcName = "System::createCellsBox";
+                std::string msg = "createCells command defined with " + pcom->m_funcName + "\n";
+                LOG(*m_pLogger, LogMask::Info, msg);
+            }
         }
     }
     return 0;
@@ -96,6 +109,15 @@ int parfis::System::loadSimData()
 
 /**
  * @brief Create cells for a cylindrical geometry
+ * @details Cells are created in parallel over the (x, y) columns, every thread takes 
+ * a range of x. Node flags of a column follow from the distances of its four corners 
+ * to the axis, and all cells of a column have the same flags, except the first and the 
+ * last one in z that have half of the nodes. A cell is in group A if it is full and all 
+ * 26 neighbours are full, which is known from the columns: the column and its eight 
+ * neighbour columns are full, and the cell is not next to the first or the last cell in 
+ * z. Cells of a column are counted first, and the prefix sums of the counts give the 
+ * position of every column in the presized vectors. Cells are in the order of loops 
+ * over x, y and z, and groups A and B are sorted.
  * @return Zero on success
  */
 int parfis::System::createCellsCylindrical()
@@ -109,102 +131,245 @@ int parfis::System::createCellsCylindrical()
         0.5 * m_pCfgData->geometrySize.x, 
         0.5 * m_pCfgData->geometrySize.y,
         0.5 * m_pCfgData->geometrySize.z};
-    Vec3D<double> nodePosition;
     double radiusSquared = geoCenter.x*geoCenter.x; 
-    nodeFlag_t xyNode;
-    nodeFlag_t nodeFlag;
-    cellId_t cellId;
-
-    for (cellPos_t i = 0; i < m_pCfgData->cellCount.x; i++) {
-         // Find points inside the geometry
-         for (cellPos_t j = 0; j < m_pCfgData->cellCount.y; j++) {
-            xyNode = 0;
-            nodePosition.x = i * m_pCfgData->cellSize.x;
-            nodePosition.y = j * m_pCfgData->cellSize.y;
-            if (xyDistSq(nodePosition, geoCenter) < radiusSquared)
-                xyNode |= 0b00010001;
-
-            nodePosition.x = (i + 1) * m_pCfgData->cellSize.x;
-            if (xyDistSq(nodePosition, geoCenter) < radiusSquared)
-                xyNode |= 0b00100010;
-
-            nodePosition.x = i * m_pCfgData->cellSize.x;
-            nodePosition.y = (j + 1) * m_pCfgData->cellSize.y;
-            if (xyDistSq(nodePosition, geoCenter) < radiusSquared)
-                xyNode |= 0b01000100;
-
-            nodePosition.x = (i + 1) * m_pCfgData->cellSize.x;
-            if (xyDistSq(nodePosition, geoCenter) < radiusSquared)
-                xyNode |= 0b10001000;
-
-            for (cellPos_t k = 0; k < m_pCfgData->cellCount.z; k++) {
-                nodeFlag = xyNode;
-                if (k == 0)
-                    nodeFlag &= 0b11110000;
-                else if (k == m_pCfgData->cellCount.z - 1)
-                    nodeFlag &= 0b00001111;
-
-                // Create cells that have at least one point inside the 
-                // defined geometry (node > 0)
-                if (nodeFlag) {
-                    cellId = m_pSimData->cellVec.size();
-                    m_pSimData->cellVec.push_back({ i, j, k });
-                    m_pSimData->nodeFlagVec.push_back(nodeFlag);
-                    m_pSimData->cellIdVec[
-                        m_pCfgData->getAbsoluteCellId(m_pSimData->cellVec.back().pos)] = cellId;
-                }
+    int countX = m_pCfgData->cellCount.x;
+    int countY = m_pCfgData->cellCount.y;
+    int countZ = m_pCfgData->cellCount.z;
+    size_t columnCnt = size_t(countX)*countY;
+    ThreadPool threadPool(std::max(1, std::min(m_pCfgData->threads, countX)));
+    int threadCount = threadPool.size();
+
+    // Node flags of the columns, every bit pair is a node of the bottom and the top face
+    std::vector<nodeFlag_t> xyNodeVec(columnCnt);
+    threadPool.run([&](int threadId) {
+        Vec3D<double> nodePosition;
+        for (int i = countX*threadId/threadCount; i < countX*(threadId + 1)/threadCount; i++) {
+            for (int j = 0; j < countY; j++) {
+                nodeFlag_t xyNode = 0;
+                nodePosition.x = i * m_pCfgData->cellSize.x;
+                nodePosition.y = j * m_pCfgData->cellSize.y;
+                if (xyDistSq(nodePosition, geoCenter) < radiusSquared)
+                    xyNode |= 0b00010001;
+
+                nodePosition.x = (i + 1) * m_pCfgData->cellSize.x;
+                if (xyDistSq(nodePosition, geoCenter) < radiusSquared)
+                    xyNode |= 0b00100010;
+
+                nodePosition.x = i * m_pCfgData->cellSize.x;
+                nodePosition.y = (j + 1) * m_pCfgData->cellSize.y;
+                if (xyDistSq(nodePosition, geoCenter) < radiusSquared)
+                    xyNode |= 0b01000100;
+
+                nodePosition.x = (i + 1) * m_pCfgData->cellSize.x;
+                if (xyDistSq(nodePosition, geoCenter) < radiusSquared)
+                    xyNode |= 0b10001000;
+                xyNodeVec[size_t(i)*countY + j] = xyNode;
             }
-         }
+        }
+    });
+
+    // Node flag of the cell at z in a column with the node flag xyNode
+    auto cellNodeFlag = [countZ](nodeFlag_t xyNode, int k) -> nodeFlag_t {
+        if (k == 0)
+            return xyNode & 0b11110000;
+        else if (k == countZ - 1)
+            return xyNode & 0b00001111;
+        return xyNode;
+    };
+    // Column can have cells of group A if it and its neighbour columns are full or empty
+    auto fullNeighbours = [&](int i, int j) -> bool {
+        for (int di = -1; di < 2; di++) {
+            for (int dj = -1; dj < 2; dj++) {
+                if (i + di < 0 || i + di >= countX || j + dj < 0 || j + dj >= countY)
+                    continue;
+                nodeFlag_t xyNode = xyNodeVec[size_t(i + di)*countY + j + dj];
+                if (xyNode != 0 && xyNode != 0b11111111)
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    // Number of cells and number of cells of group A of every column
+    std::vector<cellId_t> cellOffsetVec(columnCnt + 1, 0);
+    std::vector<cellId_t> cellAOffsetVec(columnCnt + 1, 0);
+    threadPool.run([&](int threadId) {
+        for (int i = countX*threadId/threadCount; i < countX*(threadId + 1)/threadCount; i++) {
+            for (int j = 0; j < countY; j++) {
+                size_t col = size_t(i)*countY + j;
+                nodeFlag_t xyNode = xyNodeVec[col];
+                cellId_t cellCnt = 0;
+                for (int k = 0; k < countZ; k++)
+                    cellCnt += cellNodeFlag(xyNode, k) != 0;
+                cellOffsetVec[col + 1] = cellCnt;
+                // Full cells are from 1 to countZ - 2, the ones next to them are in group B
+                if (xyNode == 0b11111111 && countZ > 4 && fullNeighbours(i, j))
+                    cellAOffsetVec[col + 1] = countZ - 4;
+            }
+        }
+    });
+    for (size_t col = 0; col < columnCnt; col++) {
+        cellOffsetVec[col + 1] += cellOffsetVec[col];
+        cellAOffsetVec[col + 1] += cellAOffsetVec[col];
     }
 
-    // For cylindrical we split to cells that have states that can go 
-    // off the boundary (reflection checking) and those that can't go outside
-    // the boundary
-    cellId_t nCellId;
-    Vec3D<cellPos_t> neigbourPos;
-    bool add;
-    for (cellId = 0; cellId < m_pSimData->cellVec.size(); cellId++) {
-        nodeFlag = m_pSimData->nodeFlagVec[cellId];
-        // Check neigbours of inside cells
-        if (nodeFlag == 0b11111111) {
-            add = false;
-            for (int i = -1; i < 2; i++) {
-                for (int j = -1; j < 2; j++) {
-                    for (int k = -1; k < 2; k++) {
-                        neigbourPos = m_pSimData->cellVec[cellId].pos;
-                        // neighbourPos cant have any of the components equal to zero 
-                        // (since the condition nodeFlag == 0b11111111) so the following 
-                        // lines are ok to compute
-                        neigbourPos.x += i;
-                        neigbourPos.y += j;
-                        neigbourPos.z += k;
-                        nCellId = m_pSimData->cellIdVec[m_pCfgData->getAbsoluteCellId(neigbourPos)];
-                        // If neigbour is not fully inside than the cell is stored to BVec
-                        if (nCellId != Const::noCellId) {
-                            if (m_pSimData->nodeFlagVec[nCellId] != 0b11111111) {
-                                m_pSimData->cellIdBVec.push_back(cellId);
-                                add = true;
-                            }
-                        }
-                        // Force break from nested for loops
-                        if (add) {
-                            j = 2; 
-                            i = 2;
-                            k = 2;
-                        }
-                    }
+    // Every column writes its cells, the ids are ordered as in the loops over x, y and z
+    cellId_t cellCnt = cellOffsetVec.back();
+    cellId_t cellACnt = cellAOffsetVec.back();
+    m_pSimData->cellVec.resize(cellCnt);
+    m_pSimData->nodeFlagVec.resize(cellCnt);
+    m_pSimData->cellIdAVec.resize(cellACnt);
+    m_pSimData->cellIdBVec.resize(cellCnt - cellACnt);
+    m_pSimData->cellIndex.countY = countY;
+    m_pSimData->cellIndex.shiftZ = 16;
+    m_pSimData->cellIndex.tileCnt = 1;
+    m_pSimData->cellIndex.columnVec.resize(columnCnt);
+    threadPool.run([&](int threadId) {
+        for (int i = countX*threadId/threadCount; i < countX*(threadId + 1)/threadCount; i++) {
+            for (int j = 0; j < countY; j++) {
+                size_t col = size_t(i)*countY + j;
+                nodeFlag_t xyNode = xyNodeVec[col];
+                cellId_t cellId = cellOffsetVec[col];
+                cellId_t cellAId = cellAOffsetVec[col];
+                cellId_t cellBId = cellId - cellAId;
+                bool colA = cellAOffsetVec[col + 1] > cellAId;
+                CellColumn& column = m_pSimData->cellIndex.columnVec[col];
+                column = {cellId, 0, 0};
+                for (int k = 0; k < countZ; k++) {
+                    nodeFlag_t nodeFlag = cellNodeFlag(xyNode, k);
+                    if (nodeFlag == 0) 
+                        continue;
+                    if (column.zCount == 0)
+                        column.zFirst = cellPos_t(k);
+                    column.zCount++;
+                    m_pSimData->cellVec[cellId] = {cellPos_t(i), cellPos_t(j), cellPos_t(k)};
+                    m_pSimData->nodeFlagVec[cellId] = nodeFlag;
+                    if (colA && k > 1 && k < countZ - 2)
+                        m_pSimData->cellIdAVec[cellAId++] = cellId;
+                    else
+                        m_pSimData->cellIdBVec[cellBId++] = cellId;
+                    cellId++;
                 }
             }
-            if (!add) m_pSimData->cellIdAVec.push_back(cellId);
         }
-        else {
-            m_pSimData->cellIdBVec.push_back(cellId);
+    });
+
+    std::string msg = "created " + std::to_string(m_pSimData->cellVec.size()) + 
+        " cells for cylindrical geometry with " + std::to_string(threadCount) + 
+        " threads, cell index of " + 
+        std::to_string(m_pSimData->cellIndex.columnVec.size()*sizeof(CellColumn)) + " bytes\n";
+    LOG(*m_pLogger, LogMask::Memory, msg);
+
+    return orderCells();
+}
+
+/**
+ * @brief Create cells for a box geometry
+ * @details The box is the bounding box of the simulation space, so all cells are 
+ * created and all nodes of every cell are inside the geometry. A cell is in group A if 
+ * it is not on a face of the box. Cells stay in the order of the loops over x, y and z 
+ * (CfgData::cellOrder is not used), since Particle::boundStatesBox computes the cell 
+ * id from the cell position.
+ * @return Zero on success
+ */
+int parfis::System::createCellsBox()
+{
+    int countX = m_pCfgData->cellCount.x;
+    int countY = m_pCfgData->cellCount.y;
+    int countZ = m_pCfgData->cellCount.z;
+    size_t columnCnt = size_t(countX)*countY;
+    cellId_t cellCnt = cellId_t(columnCnt*countZ);
+    m_pSimData->cellVec.resize(cellCnt);
+    m_pSimData->nodeFlagVec.assign(cellCnt, NodeFlag::InsideGeo);
+    m_pSimData->cellIdAVec.clear();
+    m_pSimData->cellIdBVec.clear();
+    m_pSimData->cellIdAVec.reserve(
+        size_t(std::max(0, countX - 2))*std::max(0, countY - 2)*std::max(0, countZ - 2));
+    m_pSimData->cellIdBVec.reserve(cellCnt - m_pSimData->cellIdAVec.capacity());
+    m_pSimData->cellIndex.countY = countY;
+    m_pSimData->cellIndex.shiftZ = 16;
+    m_pSimData->cellIndex.tileCnt = 1;
+    m_pSimData->cellIndex.columnVec.resize(columnCnt);
+    cellId_t cellId = 0;
+    for (int i = 0; i < countX; i++) {
+        for (int j = 0; j < countY; j++) {
+            m_pSimData->cellIndex.columnVec[size_t(i)*countY + j] = 
+                {cellId, 0, cellPos_t(countZ)};
+            for (int k = 0; k < countZ; k++) {
+                m_pSimData->cellVec[cellId] = {cellPos_t(i), cellPos_t(j), cellPos_t(k)};
+                if (i > 0 && i < countX - 1 && j > 0 && j < countY - 1 && 
+                    k > 0 && k < countZ - 1)
+                    m_pSimData->cellIdAVec.push_back(cellId);
+                else
+                    m_pSimData->cellIdBVec.push_back(cellId);
+                cellId++;
+            }
         }
     }
 
     std::string msg = "created " + std::to_string(m_pSimData->cellVec.size()) + 
-        " cells for cylindrical geometry\n";
+        " cells for box geometry\n";
     LOG(*m_pLogger, LogMask::Memory, msg);
+    if (m_pCfgData->cellOrder != CellOrder::Loop)
+        LOG(*m_pLogger, LogMask::Warning, "cellOrder is not used for the box geometry\n");
+    return 0;
+}
 
+/**
+ * @brief Renumbers cells along a space-filling curve (CfgData::cellOrder)
+ * @details Columns of cells are split in tiles of 2^cellTileShift cells in z, and the 
+ * tiles are ordered along the Morton or the Hilbert curve of (x, y, z >> cellTileShift). 
+ * Cells of a tile stay consecutive and ordered in z, so SimData::cellIndex stays 
+ * compact. Cells that are neighbours in x or y are then mostly close in SimData::cellVec, 
+ * SimData::nodeFlagVec and SimData::headIdVec. Groups of cells (cellIdAVec, cellIdBVec) 
+ * are renumbered and sorted. Must be called before states are created.
+ * @return Zero on success
+ */
+int parfis::System::orderCells()
+{
+    if (m_pCfgData->cellOrder == CellOrder::Loop)
+        return 0;
+    std::vector<Cell>& cellVec = m_pSimData->cellVec;
+    size_t cellCnt = cellVec.size();
+    // Coordinates of tiles must fit in the bits of the curve
+    int maxCount = std::max(std::max(m_pCfgData->cellCount.x, m_pCfgData->cellCount.y), 
+        ((m_pCfgData->cellCount.z - 1) >> cellTileShift) + 1);
+    int bits = 1;
+    while ((1 << bits) < maxCount)
+        bits++;
+    std::vector<uint64_t> keyVec(cellCnt);
+    for (size_t i = 0; i < cellCnt; i++) {
+        const Vec3D<cellPos_t>& pos = cellVec[i].pos;
+        keyVec[i] = m_pCfgData->cellOrder == CellOrder::Morton ? 
+            Global::mortonKey(pos.x, pos.y, pos.z >> cellTileShift) : 
+            Global::hilbertKey(pos.x, pos.y, pos.z >> cellTileShift, bits);
+    }
+    // Cells of a tile are already ordered in z, the stable sort keeps the order
+    std::vector<cellId_t> orderVec(cellCnt);
+    for (size_t i = 0; i < cellCnt; i++)
+        orderVec[i] = cellId_t(i);
+    std::stable_sort(orderVec.begin(), orderVec.end(), 
+        [&](cellId_t a, cellId_t b) { return keyVec[a] < keyVec[b]; });
+    std::vector<Cell> tmpCellVec(cellCnt);
+    std::vector<nodeFlag_t> tmpNodeFlagVec(cellCnt);
+    std::vector<cellId_t> newIdVec(cellCnt);
+    for (size_t i = 0; i < cellCnt; i++) {
+        tmpCellVec[i] = cellVec[orderVec[i]];
+        tmpNodeFlagVec[i] = m_pSimData->nodeFlagVec[orderVec[i]];
+        newIdVec[orderVec[i]] = cellId_t(i);
+    }
+    cellVec.swap(tmpCellVec);
+    m_pSimData->nodeFlagVec.swap(tmpNodeFlagVec);
+    for (auto pVec : {&m_pSimData->cellIdAVec, &m_pSimData->cellIdBVec}) {
+        for (auto& cellId : *pVec)
+            cellId = newIdVec[cellId];
+        std::sort(pVec->begin(), pVec->end());
+    }
+    m_pSimData->cellIndex.build(cellVec, m_pCfgData->cellCount, cellTileShift);
+    std::string msg = "cells ordered along the " + std::string(
+        m_pCfgData->cellOrder == CellOrder::Morton ? "Morton" : "Hilbert") + 
+        " curve, cell index of " + 
+        std::to_string(m_pSimData->cellIndex.columnVec.size()*sizeof(CellColumn)) + " bytes\n";
+    LOG(*m_pLogger, LogMask::Memory, msg);
     return 0;
 }
\ No newline at end of file
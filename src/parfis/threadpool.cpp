@@ -0,0 +1,72 @@
+#include "threadpool.h"
+
+/**
+ * @brief Creates the pool and starts the worker threads
+ * @param threadCount total number of threads, including the calling thread
+ */
+parfis::ThreadPool::ThreadPool(int threadCount) :
+    m_pTask(nullptr), m_generation(0), m_running(0), m_stop(false)
+{
+    for (int i = 1; i < threadCount; i++)
+        m_threadVec.emplace_back(&ThreadPool::work, this, i);
+}
+
+parfis::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_startCv.notify_all();
+    for (auto& thread : m_threadVec)
+        thread.join();
+}
+
+/**
+ * @brief Runs the task on all threads and waits for all of them to finish
+ * @param task function called with the thread id
+ */
+void parfis::ThreadPool::run(const std::function<void(int)>& task)
+{
+    if (m_threadVec.empty()) {
+        task(0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pTask = &task;
+        m_running = int(m_threadVec.size());
+        m_generation++;
+    }
+    m_startCv.notify_all();
+    task(0);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCv.wait(lock, [this] { return m_running == 0; });
+    m_pTask = nullptr;
+}
+
+/**
+ * @brief Loop of the worker thread
+ * @param threadId id of the thread
+ */
+void parfis::ThreadPool::work(int threadId)
+{
+    uint64_t generation = 0;
+    const std::function<void(int)>* pTask;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_startCv.wait(lock, [&] { return m_stop || m_generation != generation; });
+            if (m_stop)
+                return;
+            generation = m_generation;
+            pTask = m_pTask;
+        }
+        (*pTask)(threadId);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running--;
+        }
+        m_doneCv.notify_one();
+    }
+}